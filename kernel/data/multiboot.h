@@ -0,0 +1,62 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "types.h"
+
+// Value in EAX when a Multiboot-compliant loader jumps to the kernel
+#define MULTIBOOT_BOOTLOADER_MAGIC 0x2BADB002
+
+// Multiboot info flags (which fields below are valid)
+#define MULTIBOOT_INFO_MEMORY      (1 << 0)   // mem_lower / mem_upper
+#define MULTIBOOT_INFO_MEM_MAP     (1 << 6)   // mmap_length / mmap_addr
+#define MULTIBOOT_INFO_VBE         (1 << 11)  // vbe_* fields
+#define MULTIBOOT_INFO_FRAMEBUFFER (1 << 12)  // framebuffer_* fields
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE        1
+#define MULTIBOOT_MEMORY_RESERVED         2
+#define MULTIBOOT_MEMORY_ACPI_RECLAIMABLE 3
+#define MULTIBOOT_MEMORY_NVS              4
+#define MULTIBOOT_MEMORY_BADRAM           5
+
+// Multiboot information structure passed by the boot loader in EBX
+typedef struct {
+    uint32_t flags;             // Which of the fields below are valid
+    uint32_t mem_lower;         // KB of conventional memory
+    uint32_t mem_upper;         // KB of memory above 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;       // Size of the memory map buffer in bytes
+    uint32_t mmap_addr;         // Physical address of the first map entry
+    uint32_t drives_length;
+    uint32_t drives_addr;
+    uint32_t config_table;
+    uint32_t boot_loader_name;
+    uint32_t apm_table;
+    uint32_t vbe_control_info;
+    uint32_t vbe_mode_info;
+    uint16_t vbe_mode;
+    uint16_t vbe_interface_seg;
+    uint16_t vbe_interface_off;
+    uint16_t vbe_interface_len;
+    uint64_t framebuffer_addr;  // Physical address of the linear framebuffer
+    uint32_t framebuffer_pitch; // Bytes per scanline
+    uint32_t framebuffer_width; // Pixels
+    uint32_t framebuffer_height;
+    uint8_t  framebuffer_bpp;
+    uint8_t  framebuffer_type;
+    uint8_t  color_info[6];     // Field position/mask size pairs for R, G, B
+} __attribute__((packed)) multiboot_info_t;
+
+// Memory map entry; 'size' does not count itself
+typedef struct {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __attribute__((packed)) multiboot_mmap_entry_t;
+
+#endif // MULTIBOOT_H
@@ -0,0 +1,279 @@
+#include "allocprof.h"
+#include "mm.h"
+#include "screen.h"
+#include "data/types.h"
+#include "interrupts/interrupt.h"
+
+/*
+ * Allocation profiler.
+ *
+ * Every kmalloc made while profiling is on is charged to its callsite (the
+ * return address of the kmalloc caller) in an open-addressed table of
+ * ALLOCPROF_SITES entries. To give frees back to the right site, each live
+ * block is also remembered in a second table keyed by its address; when
+ * either table is full the allocation is only counted as dropped.
+ *
+ * Both tables use linear probing. Sites are never removed, so a site's slot
+ * index stays valid for snapshots; live blocks are removed by shifting the
+ * rest of their probe run back, which keeps lookups tombstone-free.
+ */
+
+#define TOP_DEFAULT 10
+
+// Forward declarations for print_int/print_hex from shell.c
+extern void print_int(int num);
+extern void print_hex(uint32_t value);
+
+typedef struct {
+    uint32_t site;              // Return address, 0 while the slot is empty
+    uint32_t count;             // Allocations since profiling was switched on
+    uint32_t bytes;             // Bytes they asked for
+    uint32_t live_count;        // Of those, still allocated
+    uint32_t live_bytes;
+} alloc_site_t;
+
+typedef struct {
+    uint32_t ptr;               // Block address, 0 while the slot is empty
+    uint32_t bytes;
+    uint32_t site;              // Slot in sites[]
+} live_block_t;
+
+typedef struct {
+    uint32_t live_count[ALLOCPROF_SITES];   // Per slot in sites[]
+    uint32_t live_bytes[ALLOCPROF_SITES];
+} snapshot_t;
+
+boolean allocprof_active = FALSE;
+
+static alloc_site_t sites[ALLOCPROF_SITES];
+static live_block_t live[ALLOCPROF_LIVE];
+static snapshot_t snapshots[2];                     // The last two, older first
+static uint32_t snapshot_count = 0;                 // Taken since switching on, up to 2
+static uint32_t dropped = 0;                        // Allocations no table had room for
+
+/* Hashing */
+// Multiplicative hash; the low two bits of both keys carry no information
+static inline uint32_t hash_addr(uint32_t addr, uint32_t bits) {
+    return (uint32_t)((addr >> 2) * 2654435761U) >> (32 - bits);
+}
+
+// Slot for site, claiming an empty one if it is new; -1 when the table is full
+static int32_t site_slot(uint32_t site) {
+    uint32_t mask = ALLOCPROF_SITES - 1;
+    uint32_t slot = hash_addr(site, ALLOCPROF_SITE_BITS);
+    for (uint32_t n = 0; n < ALLOCPROF_SITES; n++, slot = (slot + 1) & mask) {
+        if (sites[slot].site == site) {
+            return slot;
+        }
+        if (sites[slot].site == 0) {
+            sites[slot].site = site;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static int32_t live_find(uint32_t ptr) {
+    uint32_t mask = ALLOCPROF_LIVE - 1;
+    uint32_t slot = hash_addr(ptr, ALLOCPROF_LIVE_BITS);
+    for (uint32_t n = 0; n < ALLOCPROF_LIVE; n++, slot = (slot + 1) & mask) {
+        if (live[slot].ptr == ptr) {
+            return slot;
+        }
+        if (live[slot].ptr == 0) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+// Drop a live block, charging the free to its site
+static void live_remove(uint32_t slot) {
+    alloc_site_t* site = &sites[live[slot].site];
+    site->live_count--;
+    site->live_bytes -= live[slot].bytes;
+
+    // Pull later members of the probe run back into the hole, unless their
+    // home slot lies between the hole and where they sit now
+    uint32_t mask = ALLOCPROF_LIVE - 1;
+    uint32_t hole = slot;
+    uint32_t next = slot;
+    for (;;) {
+        live[hole].ptr = 0;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (live[next].ptr == 0) {
+                return;
+            }
+            uint32_t home = hash_addr(live[next].ptr, ALLOCPROF_LIVE_BITS);
+            boolean stays = (next > hole) ? (home > hole && home <= next)
+                                          : (home > hole || home <= next);
+            if (!stays) {
+                break;
+            }
+        }
+        live[hole] = live[next];
+        hole = next;
+    }
+}
+
+/* Heap hooks */
+void allocprof_enable(boolean on) {
+    uint32_t flags = irq_save();
+    if (on && !allocprof_active) {
+        memset(sites, 0, sizeof(sites));
+        memset(live, 0, sizeof(live));
+        snapshot_count = 0;
+        dropped = 0;
+    }
+    allocprof_active = on;
+    irq_restore(flags);
+}
+
+void allocprof_alloc(const void* ptr, uint32_t bytes, const void* site) {
+    uint32_t flags = irq_save();
+
+    // A block freed while profiling was off may still be listed
+    int32_t stale = live_find((uint32_t)ptr);
+    if (stale >= 0) {
+        live_remove(stale);
+    }
+
+    int32_t slot = site_slot((uint32_t)site);
+    if (slot < 0) {
+        dropped++;
+        irq_restore(flags);
+        return;
+    }
+    sites[slot].count++;
+    sites[slot].bytes += bytes;
+
+    uint32_t mask = ALLOCPROF_LIVE - 1;
+    uint32_t index = hash_addr((uint32_t)ptr, ALLOCPROF_LIVE_BITS);
+    for (uint32_t n = 0; n < ALLOCPROF_LIVE; n++, index = (index + 1) & mask) {
+        if (live[index].ptr == 0) {
+            live[index].ptr = (uint32_t)ptr;
+            live[index].bytes = bytes;
+            live[index].site = slot;
+            sites[slot].live_count++;
+            sites[slot].live_bytes += bytes;
+            irq_restore(flags);
+            return;
+        }
+    }
+    dropped++;
+    irq_restore(flags);
+}
+
+void allocprof_free(const void* ptr) {
+    uint32_t flags = irq_save();
+    int32_t slot = live_find((uint32_t)ptr);
+    if (slot >= 0) {
+        live_remove(slot);
+    }
+    irq_restore(flags);
+}
+
+/* Reports */
+static void print_footer(void) {
+    if (!allocprof_active) {
+        print_string("(profiling is off: debug --memory on)\n");
+    }
+    if (dropped > 0) {
+        print_int(dropped);
+        print_string(" allocations not tracked (tables full)\n");
+    }
+}
+
+void allocprof_dump_top(uint32_t count) {
+    if (count == 0) {
+        count = TOP_DEFAULT;
+    }
+
+    // Selection by bytes; reporting is rare and the table is small
+    uint8_t shown[ALLOCPROF_SITES];
+    memset(shown, 0, sizeof(shown));
+
+    print_string("  Callsite       Allocs      Bytes  Live blocks  Live bytes\n");
+    for (uint32_t rank = 0; rank < count; rank++) {
+        int32_t best = -1;
+        for (uint32_t i = 0; i < ALLOCPROF_SITES; i++) {
+            if (sites[i].site != 0 && !shown[i] &&
+                (best < 0 || sites[i].bytes > sites[best].bytes)) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        shown[best] = 1;
+
+        const alloc_site_t* site = &sites[best];
+        print_string("  ");
+        print_hex(site->site);
+        print_padded(site->count, 9);
+        print_padded(site->bytes, 11);
+        print_padded(site->live_count, 13);
+        print_padded(site->live_bytes, 12);
+        print_string("\n");
+    }
+    print_footer();
+}
+
+void allocprof_snapshot(void) {
+    uint32_t flags = irq_save();
+    snapshots[0] = snapshots[1];
+    for (uint32_t i = 0; i < ALLOCPROF_SITES; i++) {
+        snapshots[1].live_count[i] = sites[i].live_count;
+        snapshots[1].live_bytes[i] = sites[i].live_bytes;
+    }
+    if (snapshot_count < 2) {
+        snapshot_count++;
+    }
+    irq_restore(flags);
+}
+
+void allocprof_dump_leaks(void) {
+    if (snapshot_count < 2) {
+        print_string("Need two snapshots: run 'allocs snapshot' before and after\n");
+        return;
+    }
+
+    // Sites that held more live memory at the newer snapshot, biggest first
+    const snapshot_t* before = &snapshots[0];
+    const snapshot_t* after = &snapshots[1];
+    uint8_t shown[ALLOCPROF_SITES];
+    memset(shown, 0, sizeof(shown));
+
+    print_string("  Callsite      +Bytes  Live blocks\n");
+    uint32_t listed = 0;
+    for (;;) {
+        int32_t best = -1;
+        uint32_t best_growth = 0;
+        for (uint32_t i = 0; i < ALLOCPROF_SITES; i++) {
+            if (shown[i] || after->live_bytes[i] <= before->live_bytes[i]) {
+                continue;
+            }
+            uint32_t growth = after->live_bytes[i] - before->live_bytes[i];
+            if (growth > best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        shown[best] = 1;
+        listed++;
+
+        print_string("  ");
+        print_hex(sites[best].site);
+        print_padded(best_growth, 10);
+        print_padded(after->live_count[best], 13);
+        print_string("\n");
+    }
+    if (listed == 0) {
+        print_string("  No callsite grew between the snapshots\n");
+    }
+    print_footer();
+}
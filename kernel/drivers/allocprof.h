@@ -0,0 +1,29 @@
+#ifndef ALLOCPROF_H
+#define ALLOCPROF_H
+
+#include "data/types.h"
+#include "screen.h" // For boolean type
+
+// Table sizes (powers of two)
+#define ALLOCPROF_SITE_BITS 8
+#define ALLOCPROF_LIVE_BITS 12
+#define ALLOCPROF_SITES     (1UL << ALLOCPROF_SITE_BITS)   // Distinct callsites
+#define ALLOCPROF_LIVE      (1UL << ALLOCPROF_LIVE_BITS)   // Live blocks tracked for leaks
+
+// kmalloc/kfree only call in here while this is set, so a disabled
+// profiler costs one load and branch per call
+extern boolean allocprof_active;
+
+// Switching on starts from empty tables
+void allocprof_enable(boolean on);
+
+// Hooks for the heap: site is the return address of whoever called kmalloc
+void allocprof_alloc(const void* ptr, uint32_t bytes, const void* site);
+void allocprof_free(const void* ptr);
+
+// Reports for the shell
+void allocprof_dump_top(uint32_t count);    // Heaviest callsites by bytes allocated
+void allocprof_snapshot(void);              // Remember live bytes per callsite (last two kept)
+void allocprof_dump_leaks(void);            // Callsites whose live bytes grew between them
+
+#endif // ALLOCPROF_H
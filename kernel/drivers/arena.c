@@ -0,0 +1,105 @@
+#include "arena.h"
+#include "mm.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+#define ARENA_ALIGN        16
+#define ARENA_HEADER_SIZE  ((sizeof(arena_chunk_t) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+// Grab a chunk big enough for size bytes past the header
+static arena_chunk_t* chunk_create(size_t size) {
+    uint32_t order = 0;
+    while ((PAGE_SIZE << order) - ARENA_HEADER_SIZE < size) {
+        if (++order > MAX_PAGE_ORDER) {
+            return NULL;
+        }
+    }
+
+    arena_chunk_t* chunk = (arena_chunk_t*)alloc_pages(order);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->order = order;
+    chunk->used = ARENA_HEADER_SIZE;
+    chunk->size = PAGE_SIZE << order;
+    return chunk;
+}
+
+void arena_init(arena_t* arena) {
+    arena->head = NULL;
+    arena->allocated = 0;
+    arena->peak = 0;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    arena_chunk_t* chunk = arena->head;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        chunk = chunk_create(size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+
+    void* ptr = (uint8_t*)chunk + chunk->used;
+    chunk->used += size;
+
+    arena->allocated += size;
+    if (arena->allocated > arena->peak) {
+        arena->peak = arena->allocated;
+    }
+    return ptr;
+}
+
+char* arena_strdup(arena_t* arena, const char* str) {
+    size_t len = 0;
+    while (str[len]) {
+        len++;
+    }
+
+    char* copy = (char*)arena_alloc(arena, len + 1);
+    if (copy != NULL) {
+        memcpy(copy, str, len + 1);
+    }
+    return copy;
+}
+
+void arena_reset(arena_t* arena) {
+    // Keep the oldest chunk, normally a single page, so the common case of
+    // a small command never touches the frame allocator again
+    arena_chunk_t* keep = NULL;
+    arena_chunk_t* chunk = arena->head;
+    while (chunk != NULL) {
+        arena_chunk_t* next = chunk->next;
+        if (next == NULL && chunk->order == 0) {
+            keep = chunk;
+        } else {
+            free_pages(chunk, chunk->order);
+        }
+        chunk = next;
+    }
+
+    if (keep != NULL) {
+        keep->used = ARENA_HEADER_SIZE;
+    }
+    arena->head = keep;
+    arena->allocated = 0;
+}
+
+void arena_release(arena_t* arena) {
+    arena_reset(arena);
+    if (arena->head != NULL) {
+        free_pages(arena->head, arena->head->order);
+        arena->head = NULL;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "data/types.h"
+
+// Bump-pointer arena: allocations are never freed one by one, the whole
+// arena is emptied at once with arena_reset(). Backed by page runs from
+// alloc_pages(), chained as they fill up.
+typedef struct arena_chunk {
+    struct arena_chunk* next;   // Previously filled chunk
+    uint32_t order;             // Chunk spans 2^order frames
+    uint32_t used;              // Bytes handed out, header included
+    uint32_t size;              // Total bytes in the chunk
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t* head;        // Chunk currently being filled
+    uint32_t allocated;         // Bytes handed out since the last reset
+    uint32_t peak;              // Most bytes ever handed out between resets
+} arena_t;
+
+void arena_init(arena_t* arena);
+void* arena_alloc(arena_t* arena, size_t size);   // 16-byte aligned, NULL when out of memory
+char* arena_strdup(arena_t* arena, const char* str);
+void arena_reset(arena_t* arena);                 // Keeps one page for the next round
+void arena_release(arena_t* arena);               // Returns every page
+
+#endif // ARENA_H
@@ -0,0 +1,322 @@
+#include "mm.h"
+#include "paging.h"
+#include "screen.h"
+#include "data/types.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * General-purpose heap for mid-sized kmalloc requests.
+ *
+ * Lives at HEAP_START in the kernel half and starts out with HEAP_INITIAL
+ * bytes mapped. When nothing fits it maps more frames at the end, up to
+ * HEAP_MAX, and when the last block is free it hands whole trailing pages
+ * back to the frame allocator.
+ *
+ * Every block carries its size in a header and a footer (boundary tags), so
+ * on free both neighbours are found in O(1) and merged straight away. Free
+ * blocks sit on one of HEAP_BINS lists by power-of-two size; allocation
+ * takes the first block that fits, starting at the request's own bin.
+ */
+
+#define HEAP_MAGIC        0x4EA9B10CUL
+#define HEAP_ALIGN        16
+#define HEAP_USED         0x1UL       // Low bit of the size tags
+#define HEAP_GROW_MIN     (8 * PAGE_SIZE) // Grow in runs of at least 32KB
+#define HEAP_TRIM_MIN     (2 * PAGE_SIZE) // Only give back runs this big (hysteresis)
+#define HEAP_BINS         24
+
+// Header at the start of every block; the payload follows it
+typedef struct heap_block {
+    uint32_t size;              // Whole block in bytes, HEAP_USED bit when allocated
+    uint32_t magic;             // HEAP_MAGIC
+    struct heap_block* next;    // Free list links, only meaningful while free
+    struct heap_block* prev;
+} heap_block_t;
+
+#define HEAP_HEADER_SIZE  sizeof(heap_block_t)          // Keeps payloads 16-byte aligned
+#define HEAP_FOOTER_SIZE  sizeof(uint32_t)              // Copy of the size tag
+#define HEAP_MIN_BLOCK    ((HEAP_HEADER_SIZE + HEAP_FOOTER_SIZE + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1))
+
+/* Heap state */
+static heap_block_t* bins[HEAP_BINS];
+static uint32_t heap_end = HEAP_START;     // First unmapped byte
+static boolean heap_ready = FALSE;
+static uint32_t free_bytes = 0;            // Bytes in free blocks
+
+/* Block helpers */
+static inline uint32_t block_size(const heap_block_t* block) {
+    return block->size & ~HEAP_USED;
+}
+
+static inline uint32_t* block_footer(heap_block_t* block) {
+    return (uint32_t*)((uint8_t*)block + block_size(block) - HEAP_FOOTER_SIZE);
+}
+
+static inline void block_set(heap_block_t* block, uint32_t size, uint32_t used) {
+    block->size = size | used;
+    block->magic = HEAP_MAGIC;
+    *block_footer(block) = size | used;
+}
+
+static inline heap_block_t* block_next(heap_block_t* block) {
+    uint32_t next = (uint32_t)block + block_size(block);
+    return next < heap_end ? (heap_block_t*)next : NULL;
+}
+
+// The footer just below a block tells us where the previous one starts
+static inline heap_block_t* block_prev(heap_block_t* block) {
+    if ((uint32_t)block == HEAP_START) {
+        return NULL;
+    }
+    uint32_t prev_size = *((uint32_t*)block - 1) & ~HEAP_USED;
+    return (heap_block_t*)((uint8_t*)block - prev_size);
+}
+
+static inline uint32_t bin_index(uint32_t size) {
+    uint32_t bin = 31 - __builtin_clz(size);
+    return bin < HEAP_BINS ? bin : HEAP_BINS - 1;
+}
+
+/* Free lists */
+static void bin_insert(heap_block_t* block) {
+    uint32_t bin = bin_index(block_size(block));
+    block->prev = NULL;
+    block->next = bins[bin];
+    if (bins[bin]) {
+        bins[bin]->prev = block;
+    }
+    bins[bin] = block;
+    free_bytes += block_size(block);
+}
+
+static void bin_remove(heap_block_t* block) {
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        bins[bin_index(block_size(block))] = block->next;
+    }
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+    free_bytes -= block_size(block);
+}
+
+/* Growing and shrinking */
+// Map frames for [heap_end, heap_end + bytes); bytes is page aligned
+static boolean heap_map(uint32_t bytes) {
+    uint32_t start = heap_end;
+    for (uint32_t virt = start; virt < start + bytes; virt += PAGE_SIZE) {
+        void* frame = alloc_frame();
+        if (frame == NULL || map_page(virt, (uint32_t)frame, PAGE_WRITE) != MM_SUCCESS) {
+            if (frame != NULL) {
+                free_frame(frame);
+            }
+            // Roll back what this call mapped
+            for (uint32_t undo = start; undo < virt; undo += PAGE_SIZE) {
+                phys_addr_t phys;
+                if (paging_translate(undo, &phys)) {
+                    unmap_page(undo);
+                    free_frame((void*)(uint32_t)phys);
+                }
+            }
+            return FALSE;
+        }
+    }
+    heap_end += bytes;
+    return TRUE;
+}
+
+static void heap_unmap(uint32_t new_end) {
+    for (uint32_t virt = new_end; virt < heap_end; virt += PAGE_SIZE) {
+        phys_addr_t phys;
+        if (paging_translate(virt, &phys)) {
+            unmap_page(virt);
+            free_frame((void*)(uint32_t)phys);
+        }
+    }
+    heap_end = new_end;
+}
+
+// Extend the heap so a free block of at least size bytes sits at the end
+static heap_block_t* heap_grow(uint32_t size) {
+    // A free last block only needs topping up
+    heap_block_t* last = NULL;
+    uint32_t have = 0;
+    if (heap_end > HEAP_START) {
+        last = block_prev((heap_block_t*)heap_end);
+        if (last->size & HEAP_USED) {
+            last = NULL;
+        } else {
+            have = block_size(last);
+        }
+    }
+
+    uint32_t bytes = (size - have + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (bytes < HEAP_GROW_MIN) {
+        bytes = HEAP_GROW_MIN;
+    }
+    if (heap_end + bytes > HEAP_START + HEAP_MAX) {
+        bytes = HEAP_START + HEAP_MAX - heap_end;
+        if (bytes + have < size) {
+            return NULL;
+        }
+    }
+
+    uint32_t old_end = heap_end;
+    if (!heap_map(bytes)) {
+        return NULL;
+    }
+
+    heap_block_t* block = (heap_block_t*)old_end;
+    if (last != NULL) {
+        bin_remove(last);
+        block = last;
+    }
+    block_set(block, heap_end - (uint32_t)block, 0);
+    bin_insert(block);
+    return block;
+}
+
+// Give trailing pages back when the last block is free and big enough
+static void heap_trim(heap_block_t* last) {
+    uint32_t start = (uint32_t)last;
+    uint32_t keep_end = (start + HEAP_MIN_BLOCK + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (start % PAGE_SIZE == 0) {
+        keep_end = start; // The whole block can go
+    }
+    if (keep_end < HEAP_START + HEAP_INITIAL) {
+        keep_end = HEAP_START + HEAP_INITIAL;
+    }
+    if (keep_end >= heap_end || heap_end - keep_end < HEAP_TRIM_MIN) {
+        return;
+    }
+
+    bin_remove(last);
+    heap_unmap(keep_end);
+    if (keep_end > start) {
+        block_set(last, keep_end - start, 0);
+        bin_insert(last);
+    }
+}
+
+/* Initialization */
+static boolean heap_init(void) {
+    // Addresses in the kernel half only mean something on the kernel page tables
+    if (!paging_enabled()) {
+        return FALSE;
+    }
+
+    for (uint32_t i = 0; i < HEAP_BINS; i++) {
+        bins[i] = NULL;
+    }
+    heap_end = HEAP_START;
+    free_bytes = 0;
+
+    if (!heap_map(HEAP_INITIAL)) {
+        return FALSE;
+    }
+    heap_block_t* block = (heap_block_t*)HEAP_START;
+    block_set(block, HEAP_INITIAL, 0);
+    bin_insert(block);
+
+    heap_ready = TRUE;
+    return TRUE;
+}
+
+/* Public interface (used by kmalloc) */
+void* heap_alloc(size_t size) {
+    if (size == 0 || size > HEAP_MAX) {
+        return NULL;
+    }
+    if (!heap_ready && !heap_init()) {
+        return NULL;
+    }
+
+    uint32_t needed = (size + HEAP_HEADER_SIZE + HEAP_FOOTER_SIZE + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+
+    // First fit, starting with the bin the request falls in
+    heap_block_t* block = NULL;
+    for (uint32_t bin = bin_index(needed); bin < HEAP_BINS && block == NULL; bin++) {
+        for (heap_block_t* b = bins[bin]; b != NULL; b = b->next) {
+            if (block_size(b) >= needed) {
+                block = b;
+                break;
+            }
+        }
+    }
+    if (block == NULL) {
+        block = heap_grow(needed);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    bin_remove(block);
+
+    // Split off the tail when it is big enough to be a block of its own
+    uint32_t total = block_size(block);
+    if (total - needed >= HEAP_MIN_BLOCK) {
+        heap_block_t* rest = (heap_block_t*)((uint8_t*)block + needed);
+        block_set(rest, total - needed, 0);
+        bin_insert(rest);
+        total = needed;
+    }
+    block_set(block, total, HEAP_USED);
+
+    return (uint8_t*)block + HEAP_HEADER_SIZE;
+}
+
+boolean heap_free(void* ptr) {
+    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+    if (block->magic != HEAP_MAGIC || !(block->size & HEAP_USED)) {
+        print_string("heap_free: bad or double free\n");
+        return FALSE;
+    }
+
+    uint32_t size = block_size(block);
+
+    // Merge with free neighbours on both sides
+    heap_block_t* next = block_next(block);
+    if (next != NULL && !(next->size & HEAP_USED)) {
+        bin_remove(next);
+        next->magic = 0;
+        size += block_size(next);
+    }
+    heap_block_t* prev = block_prev(block);
+    if (prev != NULL && !(prev->size & HEAP_USED)) {
+        bin_remove(prev);
+        block->magic = 0;
+        size += block_size(prev);
+        block = prev;
+    }
+
+    block_set(block, size, 0);
+    bin_insert(block);
+
+    if ((uint32_t)block + size == heap_end) {
+        heap_trim(block);
+    }
+    return TRUE;
+}
+
+boolean heap_owns(const void* ptr) {
+    return heap_ready && (uint32_t)ptr >= HEAP_START && (uint32_t)ptr < heap_end;
+}
+
+// Payload bytes available in the block behind ptr
+size_t heap_usable_size(const void* ptr) {
+    const heap_block_t* block = (const heap_block_t*)((const uint8_t*)ptr - HEAP_HEADER_SIZE);
+    return block_size(block) - HEAP_HEADER_SIZE - HEAP_FOOTER_SIZE;
+}
+
+uint32_t heap_mapped_bytes(void) {
+    return heap_end - HEAP_START;
+}
+
+uint32_t heap_free_bytes(void) {
+    return free_bytes;
+}
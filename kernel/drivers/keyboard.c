@@ -6,6 +6,13 @@
 #define KEYBOARD_COMMAND_PORT 0x64
 #define BUFFER_SIZE 256
 
+// Scrollback keys: make codes that follow an 0xE0 prefix. Without it the
+// same codes are keypad 9 and 3.
+#define SCANCODE_EXTENDED  0xE0
+#define SCANCODE_PAGE_UP   0x49
+#define SCANCODE_PAGE_DOWN 0x51
+#define PAGE_SCROLL_LINES  20
+
 static char scancode_to_ascii[] = {
     0, 0, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
     '\t', 'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']', '\n',
@@ -46,12 +53,23 @@ boolean keyboard_data_available(void) {
 }
 
 char read_char(void) {
+    boolean extended = FALSE;
     while(1) {
         if(inb(KEYBOARD_STATUS_PORT) & 1) {
             unsigned char scancode = inb(KEYBOARD_DATA_PORT);
-            if(scancode < sizeof(scancode_to_ascii) && scancode_to_ascii[scancode]) {
+            if(scancode == SCANCODE_EXTENDED) {
+                extended = TRUE;
+                continue;
+            }
+            if(extended && scancode == SCANCODE_PAGE_UP) {
+                screen_scroll_view(PAGE_SCROLL_LINES);
+            } else if(extended && scancode == SCANCODE_PAGE_DOWN) {
+                screen_scroll_view(-PAGE_SCROLL_LINES);
+            } else if(scancode < sizeof(scancode_to_ascii) && scancode_to_ascii[scancode]) {
+                // Other extended keys (keypad Enter, /) read as their main keys
                 return scancode_to_ascii[scancode];
             }
+            extended = FALSE;
         }
     }
 }
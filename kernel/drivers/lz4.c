@@ -0,0 +1,203 @@
+#include "lz4.h"
+#include "mm.h"
+#include "data/types.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * LZ4 block compressor.
+ *
+ * A block is a run of sequences. Each starts with a token byte: the high
+ * nibble is the literal count, the low nibble the match length minus
+ * LZ4_MIN_MATCH, and 15 in either means more length bytes follow (each 255
+ * adds 255 and keeps going). Then come the literals, a 2-byte little-endian
+ * match offset and any extra match length bytes. The last sequence is only
+ * literals.
+ *
+ * The compressor is the greedy single-probe kind: hash the next 4 bytes,
+ * look up where they were last seen, extend the match if the bytes agree.
+ * After a run of misses it skips ahead faster, so incompressible input
+ * costs little.
+ */
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_LAST_LITERALS 5       // The last 5 bytes are always literals
+#define LZ4_MF_LIMIT      12      // No match may start in the last 12 bytes
+#define LZ4_MAX_OFFSET    0xFFFF
+#define LZ4_HASH_BITS     12
+#define LZ4_SKIP_TRIGGER  6       // Misses double the step every 2^6 tries
+
+// Input offsets of the last position seen for each hash
+static uint16_t match_table[1UL << LZ4_HASH_BITS];
+
+static inline uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// Room for a length field of value len beyond its token nibble
+static inline uint32_t length_bytes(uint32_t len) {
+    return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+static inline uint8_t* write_length(uint8_t* op, uint32_t len) {
+    for (len -= 15; len >= 255; len -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// Emit literals [anchor, anchor + lit_len) plus an optional match; returns
+// the new output position or NULL if it does not fit
+static uint8_t* emit_sequence(uint8_t* op, uint8_t* op_end, const uint8_t* anchor,
+                              uint32_t lit_len, uint32_t offset, uint32_t match_len) {
+    uint32_t match_code = match_len ? match_len - LZ4_MIN_MATCH : 0;
+    uint32_t needed = 1 + length_bytes(lit_len) + lit_len +
+                      (match_len ? 2 + length_bytes(match_code) : 0);
+    if ((uint32_t)(op_end - op) < needed) {
+        return NULL;
+    }
+
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len < 15 ? lit_len : 15) << 4);
+    if (lit_len >= 15) {
+        op = write_length(op, lit_len);
+    }
+    memcpy(op, anchor, lit_len);
+    op += lit_len;
+
+    if (match_len) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(match_code < 15 ? match_code : 15);
+        if (match_code >= 15) {
+            op = write_length(op, match_code);
+        }
+    }
+    return op;
+}
+
+uint32_t lz4_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dst_cap) {
+    if (len > LZ4_MAX_INPUT) {
+        return 0;
+    }
+
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_cap;
+    uint32_t anchor = 0;
+
+    if (len > LZ4_MF_LIMIT) {
+        memset(match_table, 0, sizeof(match_table));
+
+        uint32_t limit = len - LZ4_MF_LIMIT;
+        uint32_t match_end_limit = len - LZ4_LAST_LITERALS;
+        uint32_t ip = 1;
+        uint32_t misses = 0;
+
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t h = hash4(sequence);
+            uint32_t ref = match_table[h];
+            match_table[h] = (uint16_t)ip;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(src + ref) != sequence) {
+                ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            // Extend forwards, then backwards over literals that also match
+            uint32_t match_len = LZ4_MIN_MATCH;
+            while (ip + match_len < match_end_limit && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+            while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                ip--;
+                ref--;
+                match_len++;
+            }
+
+            op = emit_sequence(op, op_end, src + anchor, ip - anchor, ip - ref, match_len);
+            if (op == NULL) {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    op = emit_sequence(op, op_end, src + anchor, len - anchor, 0, 0);
+    return op ? (uint32_t)(op - dst) : 0;
+}
+
+int32_t lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dst_cap) {
+    uint32_t ip = 0;
+    uint32_t op = 0;
+
+    while (ip < len) {
+        uint32_t token = src[ip++];
+
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint32_t b;
+            do {
+                if (ip >= len) {
+                    return -1;
+                }
+                b = src[ip++];
+                lit_len += b;
+            } while (b == 255);
+        }
+        if (lit_len > len - ip || lit_len > dst_cap - op) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == len) {
+            break; // Last sequence: literals only
+        }
+
+        if (len - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return -1;
+        }
+
+        uint32_t match_len = token & 15;
+        if (match_len == 15) {
+            uint32_t b;
+            do {
+                if (ip >= len) {
+                    return -1;
+                }
+                b = src[ip++];
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ4_MIN_MATCH;
+        if (match_len > dst_cap - op) {
+            return -1;
+        }
+
+        // Byte by byte: the match may overlap what it is copying
+        const uint8_t* from = dst + op - offset;
+        for (uint32_t i = 0; i < match_len; i++) {
+            dst[op + i] = from[i];
+        }
+        op += match_len;
+    }
+
+    return (int32_t)op;
+}
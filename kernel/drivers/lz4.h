@@ -0,0 +1,19 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "data/types.h"
+
+// LZ4 block format (no frame header or checksum). Inputs are at most 64KB,
+// which every kernel user (single pages) stays well under.
+#define LZ4_MAX_INPUT 0xFFFFUL
+
+// Compress src into dst; returns the compressed size, or 0 if it would
+// not fit in dst_cap bytes. Uses a static match table, so callers must
+// not run it concurrently (not from interrupt handlers).
+uint32_t lz4_compress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dst_cap);
+
+// Expand a block made by lz4_compress; returns the original size, or -1
+// if the block is corrupt or would overflow dst_cap bytes
+int32_t lz4_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dst_cap);
+
+#endif // LZ4_H
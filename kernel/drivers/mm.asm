@@ -7,8 +7,12 @@ section .text
 global asm_verify_memory_size
 global asm_invalidate_page
 global asm_flush_tlb
+global asm_flush_tlb_global
+global asm_load_page_directory
+global asm_enable_pae
+global asm_set_pat
 
-; Verify memory size and explicitly set correct values for VM platforms
+; Sanitize a memory size reported without a memory map
 ; uint32_t asm_verify_memory_size(uint32_t suggested_size);
 asm_verify_memory_size:
     push ebp
@@ -17,8 +21,8 @@ asm_verify_memory_size:
     ; Get the suggested size parameter
     mov eax, [ebp+8]
     
-    ; Force to 1024MB (1GB) for VM environments
-    mov eax, 0x40000000 ; 1024MB exactly
+    ; Round down to a whole page
+    and eax, 0xFFFFF000
     
 .done:
     pop ebp
@@ -54,5 +58,80 @@ asm_flush_tlb:
     pop ebp
     ret
 
+; Flush entire TLB including global pages by toggling CR4.PGE
+; void asm_flush_tlb_global();
+asm_flush_tlb_global:
+    push ebp
+    mov ebp, esp
+    
+    mov eax, cr4
+    mov edx, eax
+    and edx, ~0x80      ; Clear PGE
+    mov cr4, edx
+    mov cr4, eax        ; Restore it
+    
+    pop ebp
+    ret
+
+; Load a page directory into CR3
+; void asm_load_page_directory(uint32_t phys_addr);
+asm_load_page_directory:
+    push ebp
+    mov ebp, esp
+    
+    mov eax, [ebp+8]
+    mov cr3, eax
+    
+    pop ebp
+    ret
+
+; Program the page attribute table MSR (IA32_PAT, 0x277)
+; void asm_set_pat(uint32_t low, uint32_t high);
+asm_set_pat:
+    push ebp
+    mov ebp, esp
+    
+    ; Nothing cached may carry the old memory types across the change
+    wbinvd
+    mov eax, [ebp+8]
+    mov edx, [ebp+12]
+    mov ecx, 0x277
+    wrmsr
+    wbinvd
+    
+    pop ebp
+    ret
+
+; Switch from the 2-level boot tables to PAE tables
+; void asm_enable_pae(uint32_t pdpt_phys, uint32_t cr4_bits);
+;
+; CR4.PAE can only change with paging off, so this lives in the identity
+; mapped .boot section. Between the two CR0 writes the stack (a higher-half
+; address) is unreachable, so nothing in there may touch memory.
+section .boot progbits alloc exec write align=16
+asm_enable_pae:
+    mov edx, [esp+4]    ; PDPT physical address (32-byte aligned, below 4GB)
+    mov ecx, [esp+8]    ; Extra CR4 bits (e.g. PGE)
+    pushfd
+    cli
+    
+    mov eax, cr0
+    and eax, 0x7FFFFFFF ; Clear CR0.PG
+    mov cr0, eax
+    
+    mov eax, cr4
+    or eax, 0x20        ; CR4.PAE
+    or eax, ecx
+    mov cr4, eax
+    mov cr3, edx        ; Loads the four PDPT entries
+    
+    ; Set CR0.PG (bit 31) and CR0.WP (bit 16) so writes honour read-only pages
+    mov eax, cr0
+    or eax, 0x80010000
+    mov cr0, eax
+    
+    popfd
+    ret
+
 ; Add a .note.GNU-stack section to indicate a non-executable stack
 section .note.GNU-stack noalloc noexec nowrite progbits
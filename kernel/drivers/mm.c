@@ -1,6 +1,10 @@
 #include "mm.h"
 #include "screen.h"
+#include "timer.h"
+#include "paging.h"
+#include "zram.h"
 #include "data/types.h"
+#include "data/multiboot.h"
 
 /* Constants for memory management */
 #define KB(x) ((x) * 1024UL)
@@ -13,72 +17,329 @@
 #define UNIT_GB 2
 
 /* Memory bitmap configuration */
-#define BITMAP_START    (MB(1) + KB(512)) // Bitmap starts at 1.5MB to save space
 #define BITMAP_MAX_SIZE KB(256)          // 256KB for bitmap (can track 8GB with 4K pages)
+#define MAX_PHYS_ADDR   ((uint64_t)KERNEL_VIRTUAL_BASE) // RAM above is not identity mapped
 
-/* Heap Management - Optimized for smaller footprint */
-#ifdef UNUSED
-static uint8_t* heap_start = (uint8_t*)HEAP_START;
-static uint32_t heap_max = MB(4);       // 4MB maximum heap
-#endif
+/* Memory operation tuning */
+#define MEMOPS_NT_THRESHOLD KB(256)      // Bigger than L2: stream past the cache
 
-// These variables are actually used
-static uint32_t heap_size = 0;
+/* Pre-zeroed frame pool */
+#define ZERO_POOL_SIZE   64       // Frames kept zeroed ahead of time (256KB)
+#define ZERO_POOL_BATCH  4        // Frames zeroed per idle call, keeps input latency low
+
+/* Reclaim into zram when the bitmap runs dry */
+#define RECLAIM_BATCH    32       // Pages compressed per attempt
+
+/* Frame allocator benchmark configuration */
+#define BENCH_ALLOCS     256      // Timed alloc_frame() calls per occupancy level
+#define BENCH_MAX_RUNS   4096     // Contiguous runs tracked while filling memory
 
 /* NULL definition */
 #define NULL ((void*)0)
 
 /* Memory Manager State */
-static uint8_t* bitmap = NULL;          // Memory allocation bitmap
+static uint32_t* bitmap = NULL;         // Memory allocation bitmap (1 bit per frame)
+static uint32_t* bitmap_summary = NULL; // 1 bit per bitmap word, set when the word is full
+static uint32_t bitmap_words = 0;       // Number of 32-frame words in the bitmap
+static uint32_t summary_words = 0;      // Number of words in the summary level
 static uint32_t total_mem_size = 0;     // Total memory size in bytes
-static uint32_t physical_mem_size = 0;  // Actual physical memory size
+static uint64_t physical_mem_size = 0;  // Usable RAM reported by the memory map (all of it)
+static uint32_t usable_frames = 0;      // Frames backed by usable RAM
 static uint32_t total_frames = 0;       // Total number of frames
 static uint32_t free_frames = 0;        // Number of free frames
 static uint32_t reserved_end = 0;       // End of reserved memory region
+static uint32_t peak_used_frames = 0;   // High-water mark of usable_frames - free_frames
+
+/*
+ * Buddy allocator state.
+ *
+ * Frame n is the physical page at n * PAGE_SIZE. The bitmap above stays the
+ * authoritative per-frame used/free record; on top of it every free frame
+ * belongs to exactly one free buddy block. Free blocks are linked through a
+ * buddy_node_t stored in their first bytes, and order_maps[k] has one bit per
+ * 2^k-frame block that is set while that block sits on its zone's
+ * free_areas[k].
+ */
+typedef struct buddy_node {
+    struct buddy_node* next;
+    struct buddy_node* prev;
+} buddy_node_t;
+
+static uint8_t* order_maps[MAX_PAGE_ORDER + 1];       // "Block is free at this order" bits
+
+/*
+ * Zones of the identity-mapped RAM.
+ *
+ * ZONE_DMA and ZONE_NORMAL split the bitmap at ZONE_DMA_LIMIT, which is a
+ * whole number of summary words, and each keeps its own next-fit cursor,
+ * free count and buddy lists. Buddy blocks are aligned to their size and
+ * at most 4MB, so no block or merge ever crosses from one zone into the
+ * other. ZONE_HIGH is the high memory bitmap further down.
+ */
+#define DMA_SUMMARY_WORDS (ZONE_DMA_LIMIT / (PAGE_SIZE * 32 * 32))
+#define DMA_FRAMES        (ZONE_DMA_LIMIT / PAGE_SIZE)
+
+typedef struct {
+    uint32_t first_summary;     // Summary words [first_summary, end_summary) of the bitmap
+    uint32_t end_summary;
+    uint32_t next_fit_word;     // Bitmap word where the next search starts
+    uint32_t usable_frames;     // Frames backed by usable RAM
+    uint32_t free_frames;
+    buddy_node_t* free_areas[MAX_PAGE_ORDER + 1];  // Free block lists per order
+    uint32_t free_area_count[MAX_PAGE_ORDER + 1];  // Blocks on each list (free-run histogram)
+} zone_t;
+
+static zone_t zones[ZONE_HIGH];         // The zones the buddy allocator covers
+static const char* zone_names[MAX_ZONES] = { "DMA", "Normal", "High" };
+
+static inline zone_t* zone_of(uint32_t frame) {
+    return &zones[frame < DMA_FRAMES ? ZONE_DMA : ZONE_NORMAL];
+}
+
+/*
+ * High memory: usable RAM between MAX_PHYS_ADDR and MAX_HIGH_ADDR. It is not
+ * identity mapped, so it never enters the buddy allocator; a flat bitmap with
+ * a next-fit cursor hands out single frames that callers reach with kmap().
+ */
+static uint32_t* high_bitmap = NULL;    // 1 bit per frame above MAX_PHYS_ADDR, set when used
+static uint32_t high_bitmap_words = 0;
+static uint32_t high_next_word = 0;     // Where the next search starts
+static uint32_t high_usable_frames = 0; // Frames backed by usable RAM
+static uint32_t high_free_frames = 0;
+
+/* Pre-zeroed frames, refilled from the idle loop (frames here count as used) */
+static void* zero_pool[ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+static uint32_t zero_pool_hits = 0;
+static uint32_t zero_pool_misses = 0;
+static boolean reclaiming = FALSE;        // alloc_frame() is inside vm_reclaim()
 
-// Forward declaration of heap_blocks to fix undeclared identifier error
-typedef struct alloc_block {
-    uint32_t size;          // Size of this block (including header)
-    uint8_t is_free;        // 1 if free, 0 if used
-    struct alloc_block* next; // Next block in list
-} alloc_block_t;
+/* Physical memory map */
+static mem_region_t mem_regions[MAX_MEM_REGIONS];
+static uint32_t mem_region_count = 0;
 
-// Start of heap blocks
-static alloc_block_t* heap_blocks = NULL;
+// Physical end of the kernel image (defined in linker.ld)
+extern uint8_t kernel_end[];
 
-// Forward declaration for print_int from shell.c
+// Forward declarations for print_int/print_hex from shell.c
 extern void print_int(int num);
+extern void print_hex(uint32_t value);
 
 /* Bitmap manipulation functions */
 // Set a bit in the bitmap (mark as used)
 static inline void bitmap_set(uint32_t frame) {
-    bitmap[frame / 8] |= (1 << (frame % 8));
+    uint32_t word = frame / 32;
+    bitmap[word] |= (1UL << (frame % 32));
+    if (bitmap[word] == 0xFFFFFFFF) {
+        bitmap_summary[word / 32] |= (1UL << (word % 32));
+    }
 }
 
 // Clear a bit in the bitmap (mark as free)
 static inline void bitmap_clear(uint32_t frame) {
-    bitmap[frame / 8] &= ~(1 << (frame % 8));
+    uint32_t word = frame / 32;
+    bitmap[word] &= ~(1UL << (frame % 32));
+    bitmap_summary[word / 32] &= ~(1UL << (word % 32));
 }
 
 // Test if a bit is set in the bitmap
 static inline boolean bitmap_test(uint32_t frame) {
-    return bitmap[frame / 8] & (1 << (frame % 8));
+    return (bitmap[frame / 32] >> (frame % 32)) & 1;
 }
 
-// Find the first free frame in the bitmap
-static int32_t bitmap_first_free() {
-    for (uint32_t i = 0; i < total_frames / 8; i++) {
-        if (bitmap[i] != 0xFF) { // Not all bits are set
-            for (uint8_t j = 0; j < 8; j++) {
-                if (!(bitmap[i] & (1 << j))) {
-                    return i * 8 + j;
-                }
-            }
+// Mark a run of frames as free, a whole word at a time where possible
+static void bitmap_clear_run(uint32_t first, uint32_t count) {
+    uint32_t frame = first;
+    uint32_t end = first + count;
+    
+    while (frame < end && (frame % 32) != 0) {
+        bitmap_clear(frame++);
+    }
+    while (frame + 32 <= end) {
+        uint32_t word = frame / 32;
+        bitmap[word] = 0;
+        bitmap_summary[word / 32] &= ~(1UL << (word % 32));
+        frame += 32;
+    }
+    while (frame < end) {
+        bitmap_clear(frame++);
+    }
+}
+
+// Mark a run of frames as used, a whole word at a time where possible
+static void bitmap_set_run(uint32_t first, uint32_t count) {
+    uint32_t frame = first;
+    uint32_t end = first + count;
+    
+    while (frame < end && (frame % 32) != 0) {
+        bitmap_set(frame++);
+    }
+    while (frame + 32 <= end) {
+        uint32_t word = frame / 32;
+        bitmap[word] = 0xFFFFFFFF;
+        bitmap_summary[word / 32] |= (1UL << (word % 32));
+        frame += 32;
+    }
+    while (frame < end) {
+        bitmap_set(frame++);
+    }
+}
+
+// Find a free frame in a zone: walk its part of the summary for a word that
+// is not full, then take its lowest clear bit. The search resumes where the
+// previous one stopped (next fit), so the used prefix is not rescanned on
+// every allocation.
+static int32_t bitmap_find_free(zone_t* zone) {
+    if (zone->free_frames == 0) {
+        return -1;
+    }
+    
+    uint32_t s = zone->next_fit_word / 32;
+    
+    // One pass more than the zone has summary words: the start word is
+    // visited twice, first for the words at or after the cursor, last for
+    // the words before it
+    for (uint32_t n = 0; n <= zone->end_summary - zone->first_summary; n++) {
+        uint32_t free_words = ~bitmap_summary[s];
+        if (n == 0) {
+            free_words &= 0xFFFFFFFF << (zone->next_fit_word % 32);
+        }
+        
+        if (free_words != 0) {
+            uint32_t word = s * 32 + __builtin_ctz(free_words);
+            zone->next_fit_word = word;
+            return word * 32 + __builtin_ctz(~bitmap[word]);
+        }
+        
+        if (++s == zone->end_summary) {
+            s = zone->first_summary;
         }
     }
+    
     return -1; // No free frames
 }
 
+// Start every zone's search from its lowest frame again
+static void zones_rewind(void) {
+    for (uint32_t z = 0; z < ZONE_HIGH; z++) {
+        zones[z].next_fit_word = zones[z].first_summary * 32;
+    }
+}
+
+/* Buddy block helpers */
+static inline boolean order_map_test(uint32_t order, uint32_t frame) {
+    uint32_t block = frame >> order;
+    return order_maps[order][block / 8] & (1 << (block % 8));
+}
+
+static inline void order_map_set(uint32_t order, uint32_t frame) {
+    uint32_t block = frame >> order;
+    order_maps[order][block / 8] |= (1 << (block % 8));
+}
+
+static inline void order_map_clear(uint32_t order, uint32_t frame) {
+    uint32_t block = frame >> order;
+    order_maps[order][block / 8] &= ~(1 << (block % 8));
+}
+
+// Put a free block on its zone's list for the order
+static void buddy_insert(uint32_t frame, uint32_t order) {
+    zone_t* zone = zone_of(frame);
+    buddy_node_t* node = (buddy_node_t*)(frame * PAGE_SIZE);
+    node->prev = NULL;
+    node->next = zone->free_areas[order];
+    if (zone->free_areas[order]) {
+        zone->free_areas[order]->prev = node;
+    }
+    zone->free_areas[order] = node;
+    zone->free_area_count[order]++;
+    order_map_set(order, frame);
+}
+
+// Take a specific free block off its order's list
+static void buddy_remove(uint32_t frame, uint32_t order) {
+    zone_t* zone = zone_of(frame);
+    buddy_node_t* node = (buddy_node_t*)(frame * PAGE_SIZE);
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        zone->free_areas[order] = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    }
+    zone->free_area_count[order]--;
+    order_map_clear(order, frame);
+}
+
+// Return a block to the free lists, merging with free buddies on the way up
+static void buddy_release(uint32_t frame, uint32_t order) {
+    while (order < MAX_PAGE_ORDER) {
+        uint32_t buddy = frame ^ (1UL << order);
+        if (buddy + (1UL << order) > total_frames || !order_map_test(order, buddy)) {
+            break;
+        }
+        buddy_remove(buddy, order);
+        frame &= ~(1UL << order);
+        order++;
+    }
+    buddy_insert(frame, order);
+}
+
+// Remove one frame that the bitmap allocator picked from the buddy block
+// holding it, giving the unused halves back to the lower orders
+static void buddy_carve_frame(uint32_t frame) {
+    for (uint32_t order = 0; order <= MAX_PAGE_ORDER; order++) {
+        uint32_t head = frame & ~((1UL << order) - 1);
+        if (!order_map_test(order, head)) {
+            continue;
+        }
+        
+        buddy_remove(head, order);
+        while (order > 0) {
+            order--;
+            uint32_t half = 1UL << order;
+            if (frame >= head + half) {
+                buddy_insert(head, order);
+                head += half;
+            } else {
+                buddy_insert(head + half, order);
+            }
+        }
+        return;
+    }
+}
+
+// Check that every frame in a run is marked used (guards against double frees)
+static boolean frame_run_used(uint32_t first, uint32_t count) {
+    for (uint32_t i = first; i < first + count; i++) {
+        if (!bitmap_test(i)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Build the buddy free lists from the bitmap after reserved frames are marked
+static void buddy_init(void) {
+    for (uint32_t z = 0; z < ZONE_HIGH; z++) {
+        for (uint32_t order = 0; order <= MAX_PAGE_ORDER; order++) {
+            zones[z].free_areas[order] = NULL;
+            zones[z].free_area_count[order] = 0;
+        }
+        zones[z].free_frames = 0;
+    }
+    
+    free_frames = 0;
+    for (uint32_t frame = 0; frame < total_frames; frame++) {
+        if (!bitmap_test(frame)) {
+            buddy_release(frame, 0);
+            zone_of(frame)->free_frames++;
+            free_frames++;
+        }
+    }
+}
+
 /* Helper functions for size conversions */
 // Convert bytes to KB
 static inline uint32_t bytes_to_kb(uint32_t bytes) {
@@ -96,126 +357,331 @@ static inline uint32_t bytes_to_gb_fixed(uint32_t bytes) {
     return (bytes * 100) / GB(1);
 }
 
-// Initialize memory management
-int mm_init(uint32_t mem_size) {
-    // Store actual physical memory size reported by bootloader
-    physical_mem_size = mem_size;
-    
-    // Force memory to exact values for virtualization environments
-    if (mem_size > 900 * 1024 * 1024) {
-        // Always use 1024MB for any memory close to or above 1GB
-        print_string("Setting memory to exactly 1024MB for virtualization compatibility...\n");
-        physical_mem_size = 1024 * 1024 * 1024; // Exactly 1GB
-    } else if (mem_size >= 450 * 1024 * 1024) {
-        // Set to 512MB for any memory around 512MB
-        print_string("Setting memory to exactly 512MB...\n");
-        physical_mem_size = 512 * 1024 * 1024; // Exactly 512MB
-    } else if (mem_size >= 200 * 1024 * 1024) {
-        // Set to 256MB for any memory around 256MB
-        print_string("Setting memory to exactly 256MB...\n");
-        physical_mem_size = 256 * 1024 * 1024; // Exactly 256MB
-    }
-    
-    // Use assembly function to verify memory
-    uint32_t verified_mem = asm_verify_memory_size(physical_mem_size);
-    if (verified_mem != physical_mem_size) {
-        print_string("Memory size verification corrected to: ");
-        print_int(bytes_to_mb(verified_mem));
-        print_string(" MB\n");
-        physical_mem_size = verified_mem;
+/* Memory map handling */
+static void add_mem_region(uint64_t base, uint64_t length, uint32_t type) {
+    if (length == 0 || mem_region_count >= MAX_MEM_REGIONS) {
+        return;
     }
+    mem_regions[mem_region_count].base = base;
+    mem_regions[mem_region_count].length = length;
+    mem_regions[mem_region_count].type = type;
+    mem_region_count++;
+}
+
+// Copy the boot loader's memory map into our own region table
+static void load_multiboot_map(const multiboot_info_t* mbi) {
+    uint32_t entry_addr = mbi->mmap_addr;
+    uint32_t map_end = mbi->mmap_addr + mbi->mmap_length;
     
-    // Display detected memory in appropriate units - always in MB for consistency
-    print_string("Memory detected: ");
-    print_int(bytes_to_mb(physical_mem_size));
-    print_string(" MB\n");
+    while (entry_addr + sizeof(multiboot_mmap_entry_t) <= map_end) {
+        const multiboot_mmap_entry_t* entry = (const multiboot_mmap_entry_t*)entry_addr;
+        add_mem_region(entry->addr, entry->len, entry->type);
+        entry_addr += entry->size + sizeof(entry->size);
+    }
+}
 
-    // Use the adjusted physical_mem_size instead of mem_size for the rest of the function
-    mem_size = physical_mem_size;
+// Clip a region to the physical window [lo, hi); first is counted in frames
+// from lo. Returns FALSE if nothing is left.
+static boolean region_frames(const mem_region_t* region, boolean shrink,
+                             uint64_t lo, uint64_t hi, uint32_t* first, uint32_t* count) {
+    uint64_t start = region->base;
+    uint64_t end = region->base + region->length;
     
-    // Minimal memory requirement (absolute minimum)
-    const uint32_t MIN_MEM = MB(2);
+    // Usable ranges shrink to whole pages, reserved ones grow to cover partial pages
+    if (shrink) {
+        start = (start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+        end &= ~(uint64_t)(PAGE_SIZE - 1);
+    } else {
+        start &= ~(uint64_t)(PAGE_SIZE - 1);
+        end = (end + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    }
     
-    // Enforce minimum memory size for stability
-    if (mem_size < MIN_MEM) {
-        mem_size = MIN_MEM;  // Enforce minimum
-        print_string("WARNING: Increased to minimum required memory: 2 MB\n");
+    if (start < lo) {
+        start = lo;
+    }
+    if (end > hi) {
+        end = hi;
+    }
+    if (start >= end) {
+        return FALSE;
+    }
+    
+    *first = (uint32_t)((start - lo) >> 12);
+    *count = (uint32_t)((end - start) >> 12);
+    return TRUE;
+}
+
+static const char* region_type_name(uint32_t type) {
+    switch (type) {
+        case MEM_REGION_USABLE:   return "usable";
+        case MEM_REGION_ACPI:     return "ACPI data";
+        case MEM_REGION_NVS:      return "ACPI NVS";
+        case MEM_REGION_BAD:      return "bad RAM";
+        default:                  return "reserved";
+    }
+}
+
+static void print_phys_addr(uint64_t addr) {
+    if (addr >> 32) {
+        print_hex((uint32_t)(addr >> 32));
+        print_string(":");
+    }
+    print_hex((uint32_t)addr);
+}
+
+uint32_t mm_get_regions(const mem_region_t** regions) {
+    if (regions) {
+        *regions = mem_regions;
+    }
+    return mem_region_count;
+}
+
+uint32_t mm_get_phys_top(void) {
+    return total_frames * PAGE_SIZE;
+}
+
+// Initialize memory management
+int mm_init(uint32_t mem_size, uint32_t mboot_info_addr) {
+    const multiboot_info_t* mbi = (const multiboot_info_t*)mboot_info_addr;
+    
+    mm_select_memops();
+    
+    // Build the region table, preferring the boot loader's memory map
+    mem_region_count = 0;
+    if (mbi != NULL && (mbi->flags & MULTIBOOT_INFO_MEM_MAP)) {
+        load_multiboot_map(mbi);
+    }
+    
+    boolean have_map = (mem_region_count > 0);
+    if (!have_map) {
+        // No map: assume conventional memory plus one block above 1MB
+        uint32_t verified_mem = asm_verify_memory_size(mem_size);
+        add_mem_region(0, KB(640), MEM_REGION_USABLE);
+        if (verified_mem > MB(1)) {
+            add_mem_region(MB(1), verified_mem - MB(1), MEM_REGION_USABLE);
+        }
     }
     
-    // Make sure memory size is page-aligned
-    mem_size = (mem_size / PAGE_SIZE) * PAGE_SIZE;
+    // High memory needs PAE page tables to be reachable at all
+    uint64_t high_limit = (cpu_features & CPU_FEATURE_PAE) ? MAX_HIGH_ADDR : MAX_PHYS_ADDR;
     
-    // Reserve first 1MB for BIOS (universal standard)
-    const uint32_t RESERVED_BASE = MB(1);
+    // Usable RAM, the highest usable address below the kernel half (what
+    // the buddy allocator tracks), and the highest one above it
+    uint64_t top = 0;
+    uint64_t high_top = 0;
+    uint64_t usable = 0;
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        const mem_region_t* region = &mem_regions[i];
+        if (region->type != MEM_REGION_USABLE || region->base >= high_limit) {
+            continue;
+        }
+        
+        uint64_t end = region->base + region->length;
+        if (end > high_limit) {
+            end = high_limit;
+        }
+        usable += end - region->base;
+        if (end > MAX_PHYS_ADDR) {
+            if (end > high_top) {
+                high_top = end;
+            }
+            end = MAX_PHYS_ADDR;
+        }
+        if (region->base < MAX_PHYS_ADDR && end > top) {
+            top = end;
+        }
+    }
     
-    // Store usable memory size
-    total_mem_size = mem_size;
+    physical_mem_size = usable;
     
-    // Calculate number of frames, ensuring we don't exceed addressable memory
-    total_frames = (total_mem_size - RESERVED_BASE) / PAGE_SIZE;
+    // Display detected memory in appropriate units - always in MB for consistency
+    print_string("Memory detected: ");
+    print_int((uint32_t)(physical_mem_size >> 20));
+    print_string(" MB usable in ");
+    print_int(mem_region_count);
+    print_string(have_map ? " regions\n" : " regions (no memory map, using boot size)\n");
+    
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        print_string("  ");
+        print_phys_addr(mem_regions[i].base);
+        print_string(" - ");
+        print_phys_addr(mem_regions[i].base + mem_regions[i].length - 1);
+        print_string(" ");
+        print_string(region_type_name(mem_regions[i].type));
+        print_string("\n");
+    }
+    
+    // Minimal memory requirement (absolute minimum)
+    if (top < MB(2)) {
+        print_string("ERROR: Less than 2 MB of usable memory\n");
+        return MM_OUT_OF_MEM;
+    }
+    
+    // Store the highest usable address (page-aligned)
+    total_mem_size = (uint32_t)top & ~(PAGE_SIZE - 1);
+    
+    // Frame n covers physical address n * PAGE_SIZE, so buddy blocks are
+    // naturally aligned in physical memory
+    total_frames = total_mem_size / PAGE_SIZE;
     
     // Calculate bitmap size needed - each bit represents one page
-    uint32_t bitmap_size = (total_frames + 7) / 8;
+    bitmap_words = (total_frames + 31) / 32;
     
     // Cap bitmap size to maximum (reduce memory footprint)
-    if (bitmap_size > BITMAP_MAX_SIZE) {
-        bitmap_size = BITMAP_MAX_SIZE;
-        total_frames = bitmap_size * 8;
+    if (bitmap_words * 4 > BITMAP_MAX_SIZE) {
+        bitmap_words = BITMAP_MAX_SIZE / 4;
+        total_frames = bitmap_words * 32;
     }
+    summary_words = (bitmap_words + 31) / 32;
     
-    // Set bitmap
-    bitmap = (uint8_t*)BITMAP_START;
+    // The DMA zone is the first 16MB of the bitmap, the normal zone the rest
+    zones[ZONE_DMA].first_summary = 0;
+    zones[ZONE_DMA].end_summary = (summary_words < DMA_SUMMARY_WORDS) ? summary_words
+                                                                      : DMA_SUMMARY_WORDS;
+    zones[ZONE_NORMAL].first_summary = zones[ZONE_DMA].end_summary;
+    zones[ZONE_NORMAL].end_summary = summary_words;
+    zones_rewind();
     
-    // Ensure bitmap memory is within valid memory range
-    if ((uint32_t)bitmap + bitmap_size >= total_mem_size) {
-        return MM_ERROR;
+    // Metadata goes right after the kernel image and anything the boot
+    // loader left behind it (info block and memory map)
+    uint32_t meta_start = (uint32_t)kernel_end;
+    if (mbi != NULL) {
+        uint32_t mbi_end = mboot_info_addr + sizeof(multiboot_info_t);
+        if (mboot_info_addr >= MB(1) && mbi_end > meta_start) {
+            meta_start = mbi_end;
+        }
+        uint32_t map_end = mbi->mmap_addr + mbi->mmap_length;
+        if (have_map && mbi->mmap_addr >= MB(1) && map_end > meta_start) {
+            meta_start = map_end;
+        }
     }
+    meta_start = (meta_start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     
-    // Clear bitmap (mark all frames as free)
-    memset(bitmap, 0, bitmap_size);
+    // Set bitmap, its summary level right behind it
+    bitmap = (uint32_t*)meta_start;
+    bitmap_summary = bitmap + bitmap_words;
     
-    // Mark reserved memory as used (kernel and bitmap area)
-    uint32_t reserved_frames = (HEAP_START + KB(256)) / PAGE_SIZE; // Reserve a bit more than HEAP_START
-    if (reserved_frames > total_frames) {
-        reserved_frames = total_frames;
+    // The per-order buddy maps follow the bitmap (about two bits per frame)
+    uint32_t meta_end = (uint32_t)(bitmap_summary + summary_words);
+    for (uint32_t order = 0; order <= MAX_PAGE_ORDER; order++) {
+        uint32_t map_size = ((total_frames >> order) + 8) / 8;
+        order_maps[order] = (uint8_t*)meta_end;
+        meta_end += map_size;
     }
     
-    // Mark lower memory as reserved
-    for (uint32_t i = 0; i < reserved_frames; i++) {
-        bitmap_set(i);
+    // Then the high memory bitmap, one bit per frame from MAX_PHYS_ADDR up
+    // (512KB covers 16GB, 2MB the full 64GB)
+    uint32_t high_frames = 0;
+    if (high_top > MAX_PHYS_ADDR) {
+        high_frames = (uint32_t)((high_top - MAX_PHYS_ADDR) >> 12);
     }
+    high_bitmap_words = (high_frames + 31) / 32;
+    high_next_word = 0;
+    meta_end = (meta_end + 3) & ~3UL;
+    high_bitmap = (uint32_t*)meta_end;
+    meta_end += high_bitmap_words * 4;
     
-    // Also mark very high memory as reserved (optimized to 1MB)
-    // This is a universal approach to avoid conflicts with hardware
-    const uint32_t HIGH_RESERVED = MB(1) / PAGE_SIZE;
-    if (total_frames > HIGH_RESERVED) {
-        for (uint32_t i = total_frames - HIGH_RESERVED; i < total_frames; i++) {
-            bitmap_set(i);
+    // The metadata itself must sit in usable RAM
+    boolean meta_ok = FALSE;
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        const mem_region_t* region = &mem_regions[i];
+        if (region->type == MEM_REGION_USABLE && region->base <= meta_start &&
+            region->base + region->length >= meta_end) {
+            meta_ok = TRUE;
+            break;
         }
     }
+    if (!meta_ok) {
+        return MM_ERROR;
+    }
     
-    // Set reserved memory end address
-    reserved_end = HEAP_START;
+    // Every frame starts out used and summary bits full; buddy maps empty
+    memset(bitmap, 0xFF, (uint32_t)order_maps[0] - meta_start);
+    memset(order_maps[0], 0, (uint32_t)high_bitmap - (uint32_t)order_maps[0]);
+    memset(high_bitmap, 0xFF, high_bitmap_words * 4);
     
-    // Calculate free frames (avoid underflow)
-    free_frames = (reserved_frames < total_frames) ? 
-                  (total_frames - reserved_frames) : 0;
+    // Release usable RAM, then re-reserve anything another region claims
+    // (maps may overlap; reserved wins)
+    uint64_t low_end = (uint64_t)total_frames * PAGE_SIZE;
+    uint32_t first, count;
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        if (mem_regions[i].type == MEM_REGION_USABLE &&
+            region_frames(&mem_regions[i], TRUE, 0, low_end, &first, &count)) {
+            bitmap_clear_run(first, count);
+        }
+    }
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        if (mem_regions[i].type != MEM_REGION_USABLE &&
+            region_frames(&mem_regions[i], FALSE, 0, low_end, &first, &count)) {
+            bitmap_set_run(first, count);
+        }
+    }
     
-    // Update for high memory reservation
-    if (free_frames > HIGH_RESERVED) {
-        free_frames -= HIGH_RESERVED;
+    // Same for high memory, with its own flat bitmap
+    uint64_t high_end = MAX_PHYS_ADDR + ((uint64_t)high_frames << 12);
+    high_usable_frames = 0;
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        if (mem_regions[i].type == MEM_REGION_USABLE &&
+            region_frames(&mem_regions[i], TRUE, MAX_PHYS_ADDR, high_end, &first, &count)) {
+            for (uint32_t frame = first; frame < first + count; frame++) {
+                uint32_t bit = 1UL << (frame % 32);
+                if (high_bitmap[frame / 32] & bit) {
+                    high_bitmap[frame / 32] &= ~bit;
+                    high_usable_frames++;
+                }
+            }
+        }
     }
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        if (mem_regions[i].type != MEM_REGION_USABLE &&
+            region_frames(&mem_regions[i], FALSE, MAX_PHYS_ADDR, high_end, &first, &count)) {
+            for (uint32_t frame = first; frame < first + count; frame++) {
+                uint32_t bit = 1UL << (frame % 32);
+                if (!(high_bitmap[frame / 32] & bit)) {
+                    high_bitmap[frame / 32] |= bit;
+                    high_usable_frames--;
+                }
+            }
+        }
+    }
+    high_free_frames = high_usable_frames;
     
-    // Initialize heap with minimal initial size
-    heap_size = KB(32);  // Start with 32KB heap (reduced from 64KB)
+    // Mark reserved memory as used (BIOS area, kernel image and our metadata)
+    reserved_end = (meta_end + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    uint32_t reserved_frames = reserved_end / PAGE_SIZE;
+    if (reserved_frames > total_frames) {
+        reserved_frames = total_frames;
+    }
+    bitmap_set_run(0, reserved_frames);
     
-    // Initialize heap blocks pointer safely
-    heap_blocks = NULL; // Will be initialized on first allocation
+    // Without a memory map, keep the old guard band below the top of memory
+    if (!have_map) {
+        const uint32_t HIGH_RESERVED = MB(1) / PAGE_SIZE;
+        if (total_frames > reserved_frames + HIGH_RESERVED) {
+            bitmap_set_run(total_frames - HIGH_RESERVED, HIGH_RESERVED);
+        }
+    }
     
-    // Extra safety check - verify heap start is within valid memory
-    if (HEAP_START >= total_mem_size) {
-        return MM_ERROR;
+    // Count the RAM-backed frames for usage percentages, per zone
+    uint64_t dma_end = (low_end < ZONE_DMA_LIMIT) ? low_end : ZONE_DMA_LIMIT;
+    zones[ZONE_DMA].usable_frames = 0;
+    zones[ZONE_NORMAL].usable_frames = 0;
+    for (uint32_t i = 0; i < mem_region_count; i++) {
+        if (mem_regions[i].type != MEM_REGION_USABLE) {
+            continue;
+        }
+        if (region_frames(&mem_regions[i], TRUE, 0, dma_end, &first, &count)) {
+            zones[ZONE_DMA].usable_frames += count;
+        }
+        if (region_frames(&mem_regions[i], TRUE, dma_end, low_end, &first, &count)) {
+            zones[ZONE_NORMAL].usable_frames += count;
+        }
     }
+    usable_frames = zones[ZONE_DMA].usable_frames + zones[ZONE_NORMAL].usable_frames;
+    
+    // Seed the buddy free lists from every frame still marked free
+    buddy_init();
+    peak_used_frames = usable_frames - free_frames;
     
     return MM_SUCCESS;
 }
@@ -227,18 +693,25 @@ void mm_dump_stats_with_unit(int unit) {
     const char* unit_str;
     uint32_t total_display, free_display, used_display;
     
+    // Sizes are 64-bit once RAM goes past 4GB; shifts keep clear of
+    // 64-bit division, which needs libgcc
+    uint64_t all_frames = (uint64_t)usable_frames + high_usable_frames;
+    uint64_t all_free = (uint64_t)free_frames + high_free_frames;
+    uint64_t free_bytes = all_free << 12;
+    uint64_t used_bytes = (all_frames - all_free) << 12;
+    
     // Select display unit based on size and user preference
     if (unit == UNIT_KB) {
         unit_str = "KB";
-        total_display = bytes_to_kb(physical_mem_size);
-        free_display = bytes_to_kb(free_frames * PAGE_SIZE);
-        used_display = bytes_to_kb((total_frames - free_frames) * PAGE_SIZE);
+        total_display = (uint32_t)(physical_mem_size >> 10);
+        free_display = (uint32_t)(free_bytes >> 10);
+        used_display = (uint32_t)(used_bytes >> 10);
     } else {
         // Default to MB always, ignore GB even for large memory
         unit_str = "MB";
-        total_display = bytes_to_mb(physical_mem_size);
-        free_display = bytes_to_mb(free_frames * PAGE_SIZE);
-        used_display = bytes_to_mb((total_frames - free_frames) * PAGE_SIZE);
+        total_display = (uint32_t)(physical_mem_size >> 20);
+        free_display = (uint32_t)(free_bytes >> 20);
+        used_display = (uint32_t)(used_bytes >> 20);
     }
     
     // Display memory statistics
@@ -255,12 +728,13 @@ void mm_dump_stats_with_unit(int unit) {
     print_string(unit_str);
     
     // Calculate percentage safely (avoiding overflow)
+    // (at most 2^24 frames under PAE, so frames * 100 fits in 32 bits)
     uint32_t percentage;
-    if (physical_mem_size == 0) {
+    if (all_frames == 0) {
         percentage = 0;
     } else {
         // Scale down for precision
-        percentage = ((free_frames * 100) / total_frames);
+        percentage = ((uint32_t)all_free * 100) / (uint32_t)all_frames;
     }
     
     print_string(" (");
@@ -287,13 +761,22 @@ void mm_dump_stats_with_unit(int unit) {
     }
     
     print_string("Total Pages:  ");
-    print_int(total_frames);
+    print_int((uint32_t)all_frames);
     print_string("\n");
     
     print_string("Free Pages:   ");
-    print_int(free_frames);
+    print_int((uint32_t)all_free);
     print_string("\n");
     
+    // RAM above the identity map, only reachable through kmap()
+    if (high_usable_frames > 0) {
+        print_string("High Memory:  ");
+        print_int(high_usable_frames / (MB(1) / PAGE_SIZE));
+        print_string(" MB (");
+        print_int(high_free_frames / (MB(1) / PAGE_SIZE));
+        print_string(" MB free, PAE)\n");
+    }
+    
     // Heap info
     print_string("\n--- Heap Status ---\n");
     print_string("Heap Start:   0x");
@@ -303,7 +786,8 @@ void mm_dump_stats_with_unit(int unit) {
     }
     print_string("\n");
     
-    // Show heap size in appropriate units
+    // Show heap size in appropriate units (frames currently held by kmalloc)
+    uint32_t heap_size = kmalloc_footprint();
     print_string("Heap Size:    ");
     if (heap_size >= MB(1)) {
         print_int(heap_size / MB(1));
@@ -319,6 +803,163 @@ void mm_dump_stats_with_unit(int unit) {
     print_string("Max Heap:     ");
     print_int(HEAP_MAX / MB(1));
     print_string(" MB\n");
+    
+    // Demand-zero reservations: how much was reserved versus actually touched
+    vm_stats_t vm;
+    vm_get_stats(&vm);
+    print_string("\n--- Demand Paging ---\n");
+    print_string("Reserved:     ");
+    print_int(vm.reserved_bytes / KB(1));
+    print_string(" KB in ");
+    print_int(vm.regions);
+    print_string(" regions\n");
+    print_string("Committed:    ");
+    print_int(vm.committed_bytes / KB(1));
+    print_string(" KB\n");
+    print_string("Minor Faults: ");
+    print_int(vm.minor_faults);
+    print_string("\n");
+    
+    // Pages evicted into the compressed store
+    zram_stats_t zs;
+    zram_get_stats(&zs);
+    print_string("Compressed:   ");
+    print_int(vm.compressed_pages);
+    print_string(" pages in ");
+    print_int(zs.compressed_bytes / KB(1));
+    print_string(" KB (");
+    print_int(zs.pool_frames * (PAGE_SIZE / KB(1)));
+    print_string(" KB pool)\n");
+    if (zs.stored_pages > 0) {
+        // Ratio x100 in 64-byte units, which keeps it within 32 bits
+        uint32_t ratio = zs.stored_pages * (PAGE_SIZE / 64) * 100 / ((zs.compressed_bytes + 63) / 64);
+        print_string("Ratio:        ");
+        print_int(ratio / 100);
+        print_char('.');
+        print_int((ratio / 10) % 10);
+        print_int(ratio % 10);
+        print_string(":1\n");
+    }
+    print_string("Major Faults: ");
+    print_int(vm.major_faults);
+    if (zs.faults > 0) {
+        print_string(" (avg ");
+        print_int(zs.fault_ns_avg);
+        print_string(" ns, max ");
+        print_int(zs.fault_ns_max);
+        print_string(" ns)");
+    }
+    print_string("\n");
+}
+
+// Right-align a number in a column of the given width
+void print_padded(uint32_t value, uint32_t width) {
+    uint32_t digits = 1;
+    for (uint32_t v = value; v >= 10; v /= 10) {
+        digits++;
+    }
+    while (digits++ < width) {
+        print_char(' ');
+    }
+    print_int(value);
+}
+
+// Detailed view for meminfo --verbose
+void mm_dump_verbose(void) {
+    heap_stats_t heap;
+    kmalloc_get_stats(&heap);
+    
+    print_string("\n--- Heap Size Classes ---\n");
+    print_string("  Size  Slabs  In use / Capacity\n");
+    for (uint32_t i = 0; i < HEAP_SIZE_CLASSES; i++) {
+        const heap_class_stats_t* cls = &heap.classes[i];
+        if (cls->slabs == 0) {
+            continue;
+        }
+        print_padded(cls->object_size, 6);
+        print_padded(cls->slabs, 7);
+        print_padded(cls->in_use, 9);
+        print_string(" / ");
+        print_int(cls->capacity);
+        print_string("\n");
+    }
+    print_string("General heap: ");
+    print_int(heap.general_objects);
+    print_string(" blocks, ");
+    print_int(bytes_to_kb(heap.general_mapped));
+    print_string(" KB mapped, ");
+    print_int(bytes_to_kb(heap.general_free));
+    print_string(" KB free\n");
+    print_string("Large blocks: ");
+    print_int(heap.large_objects);
+    print_string("\nLive blocks:  ");
+    print_int(heap.live_objects);
+    print_string(" (");
+    print_int(bytes_to_kb(heap.live_bytes));
+    print_string(" KB), peak ");
+    print_int(heap.peak_objects);
+    print_string(" (");
+    print_int(bytes_to_kb(heap.peak_bytes));
+    print_string(" KB)\nHeap pages:   ");
+    print_int(heap.heap_pages);
+    print_string(", peak ");
+    print_int(heap.peak_pages);
+    print_string("\n");
+    
+    print_string("\n--- Zones ---\n");
+    print_string("  Zone       Usable KB    Free KB\n");
+    for (uint32_t z = 0; z < MAX_ZONES; z++) {
+        zone_info_t zone;
+        mm_get_zone_info(z, &zone);
+        if (zone.usable_frames == 0) {
+            continue;
+        }
+        uint32_t name_len = 0;
+        while (zone.name[name_len] != '\0') {
+            name_len++;
+        }
+        print_string("  ");
+        print_string(zone.name);
+        print_padded(zone.usable_frames * (PAGE_SIZE / KB(1)), 20 - name_len);
+        print_padded(zone.free_frames * (PAGE_SIZE / KB(1)), 11);
+        print_string("\n");
+    }
+    
+    print_string("\n--- Free Physical Blocks ---\n");
+    print_string("  Block     DMA  Normal\n");
+    for (uint32_t order = 0; order <= MAX_PAGE_ORDER; order++) {
+        print_padded(bytes_to_kb(PAGE_SIZE << order), 6);
+        print_string(" KB");
+        print_padded(zones[ZONE_DMA].free_area_count[order], 6);
+        print_padded(zones[ZONE_NORMAL].free_area_count[order], 8);
+        print_string("\n");
+    }
+    
+    mem_info_t info;
+    get_memory_info(&info);
+    print_string("Largest free block: ");
+    print_int(bytes_to_kb(info.largest_free_block));
+    print_string(" KB\nIsolated free frames: ");
+    print_int(info.fragmentation_count);
+    print_string("\n");
+    
+    print_string("\n--- Zeroed Frame Pool ---\n");
+    print_string("Pooled: ");
+    print_int(zero_pool_count);
+    print_string(" of ");
+    print_int(ZERO_POOL_SIZE);
+    print_string(" frames, hits: ");
+    print_int(zero_pool_hits);
+    print_string(", misses: ");
+    print_int(zero_pool_misses);
+    print_string("\n");
+    
+    print_string("\n--- High-Water Marks ---\n");
+    print_string("Physical used: ");
+    print_int(bytes_to_kb(info.peak_used_memory));
+    print_string(" KB of ");
+    print_int(bytes_to_kb(usable_frames * PAGE_SIZE));
+    print_string(" KB\n");
 }
 
 // Standard memory information display (defaults to MB)
@@ -326,20 +967,175 @@ void mm_dump_stats(void) {
     mm_dump_stats_with_unit(UNIT_MB);
 }
 
-/* Memory operations functions */
+/*
+ * Memory operations.
+ *
+ * The bulk copy/fill routines come in three flavours, picked once at boot by
+ * mm_select_memops() from the CPUID bits kernel_entry.asm recorded:
+ *   rep movsd/stosd  - any CPU; dwords after aligning the destination
+ *   rep movsb/stosb  - CPUs with ERMS, where microcode does the whole job
+ *   movnti           - SSE2 non-temporal stores for copies/fills too big to
+ *                      be worth caching (framebuffer blits, clearing bitmaps)
+ * movnti works on general purpose registers, so it needs neither CR4.OSFXSR
+ * nor any FPU/SSE state saving. The defaults are safe before selection runs.
+ */
+static void copy_rep(void* dest, const void* src, size_t count);
+static void fill_rep(void* dest, uint8_t value, size_t count);
+
+static void (*copy_bulk)(void*, const void*, size_t) = copy_rep;
+static void (*fill_bulk)(void*, uint8_t, size_t) = fill_rep;
+static boolean memops_nt = FALSE;
+
+// Bytes until dest is dword aligned (capped at count)
+static inline size_t align_head(const void* dest, size_t count) {
+    size_t head = (0 - (uint32_t)dest) & 3;
+    return head < count ? head : count;
+}
+
+static void copy_rep(void* dest, const void* src, size_t count) {
+    size_t head = align_head(dest, count);
+    size_t words = (count - head) / 4;
+    size_t tail = (count - head) & 3;
+    __asm__ volatile("rep movsb\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep movsl\n\t"
+                     "mov %4, %%ecx\n\t"
+                     "rep movsb"
+                     : "+D"(dest), "+S"(src), "+c"(head)
+                     : "g"(words), "g"(tail)
+                     : "memory");
+}
+
+static void copy_erms(void* dest, const void* src, size_t count) {
+    __asm__ volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(count) : : "memory");
+}
+
+static void fill_rep(void* dest, uint8_t value, size_t count) {
+    size_t head = align_head(dest, count);
+    size_t words = (count - head) / 4;
+    size_t tail = (count - head) & 3;
+    uint32_t pattern = value * 0x01010101UL;
+    __asm__ volatile("rep stosb\n\t"
+                     "mov %3, %%ecx\n\t"
+                     "rep stosl\n\t"
+                     "mov %4, %%ecx\n\t"
+                     "rep stosb"
+                     : "+D"(dest), "+c"(head)
+                     : "a"(pattern), "g"(words), "g"(tail)
+                     : "memory");
+}
+
+static void fill_erms(void* dest, uint8_t value, size_t count) {
+    __asm__ volatile("rep stosb" : "+D"(dest), "+c"(count) : "a"(value) : "memory");
+}
+
+// Large copy with non-temporal stores, 16 bytes per iteration
+static void copy_nt(void* dest, const void* src, size_t count) {
+    size_t head = align_head(dest, count);
+    copy_bulk(dest, src, head);
+    uint8_t* d = (uint8_t*)dest + head;
+    const uint8_t* s = (const uint8_t*)src + head;
+    count -= head;
+    
+    size_t blocks = count / 16;
+    if (blocks > 0) {
+        __asm__ volatile("1:\n\t"
+                         "mov (%%esi), %%eax\n\t"
+                         "mov 4(%%esi), %%edx\n\t"
+                         "movnti %%eax, (%%edi)\n\t"
+                         "movnti %%edx, 4(%%edi)\n\t"
+                         "mov 8(%%esi), %%eax\n\t"
+                         "mov 12(%%esi), %%edx\n\t"
+                         "movnti %%eax, 8(%%edi)\n\t"
+                         "movnti %%edx, 12(%%edi)\n\t"
+                         "add $16, %%esi\n\t"
+                         "add $16, %%edi\n\t"
+                         "dec %%ecx\n\t"
+                         "jnz 1b\n\t"
+                         "sfence" // Order the weakly ordered stores before returning
+                         : "+D"(d), "+S"(s), "+c"(blocks)
+                         :
+                         : "eax", "edx", "memory");
+    }
+    copy_bulk(d, s, count & 15);
+}
+
+static void fill_nt(void* dest, uint8_t value, size_t count) {
+    size_t head = align_head(dest, count);
+    fill_bulk(dest, value, head);
+    uint8_t* d = (uint8_t*)dest + head;
+    count -= head;
+    
+    size_t blocks = count / 16;
+    if (blocks > 0) {
+        __asm__ volatile("1:\n\t"
+                         "movnti %%eax, (%%edi)\n\t"
+                         "movnti %%eax, 4(%%edi)\n\t"
+                         "movnti %%eax, 8(%%edi)\n\t"
+                         "movnti %%eax, 12(%%edi)\n\t"
+                         "add $16, %%edi\n\t"
+                         "dec %%ecx\n\t"
+                         "jnz 1b\n\t"
+                         "sfence"
+                         : "+D"(d), "+c"(blocks)
+                         : "a"(value * 0x01010101UL)
+                         : "memory");
+    }
+    fill_bulk(d, value, count & 15);
+}
+
+// Overlapping copy to a higher address: tail bytes, then dwords top-down
+static void copy_backward(void* dest, const void* src, size_t count) {
+    uint8_t* d = (uint8_t*)dest;
+    const uint8_t* s = (const uint8_t*)src;
+    
+    while (count & 3) {
+        count--;
+        d[count] = s[count];
+    }
+    
+    size_t words = count / 4;
+    if (words > 0) {
+        d += count - 4;
+        s += count - 4;
+        __asm__ volatile("std\n\t"
+                         "rep movsl\n\t"
+                         "cld"
+                         : "+D"(d), "+S"(s), "+c"(words)
+                         :
+                         : "memory");
+    }
+}
+
+void mm_select_memops(void) {
+    if (cpu_features_ext & CPU_FEATURE_EXT_ERMS) {
+        copy_bulk = copy_erms;
+        fill_bulk = fill_erms;
+    } else {
+        copy_bulk = copy_rep;
+        fill_bulk = fill_rep;
+    }
+    memops_nt = (cpu_features & CPU_FEATURE_SSE2) != 0;
+    
+    print_string("Memory ops: ");
+    print_string(copy_bulk == copy_erms ? "ERMS rep movsb" : "rep movsd");
+    print_string(memops_nt ? ", SSE2 non-temporal stores from 256 KB\n" : "\n");
+}
+
 void* memset(void* dest, int value, size_t count) {
-    uint8_t* dst = (uint8_t*)dest;
-    for (size_t i = 0; i < count; i++) {
-        dst[i] = (uint8_t)value;
+    if (memops_nt && count >= MEMOPS_NT_THRESHOLD) {
+        fill_nt(dest, (uint8_t)value, count);
+    } else {
+        fill_bulk(dest, (uint8_t)value, count);
     }
     return dest;
 }
 
 void* memcpy(void* dest, const void* src, size_t count) {
-    uint8_t* dst = (uint8_t*)dest;
-    const uint8_t* s = (const uint8_t*)src;
-    for (size_t i = 0; i < count; i++) {
-        dst[i] = s[i];
+    if (memops_nt && count >= MEMOPS_NT_THRESHOLD) {
+        copy_nt(dest, src, count);
+    } else {
+        copy_bulk(dest, src, count);
     }
     return dest;
 }
@@ -348,16 +1144,16 @@ void* memmove(void* dest, const void* src, size_t count) {
     uint8_t* dst = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
     
-    if (dst < s) {
-        // Copy forward
-        for (size_t i = 0; i < count; i++) {
-            dst[i] = s[i];
-        }
-    } else if (dst > s) {
-        // Copy backward
-        for (size_t i = count; i > 0; i--) {
-            dst[i-1] = s[i-1];
+    if (dst <= s || dst >= s + count) {
+        // Forward copy is safe: dst below src, or no overlap at all.
+        // Non-temporal stores only when the ranges are disjoint.
+        if (dst < s && dst + count > s) {
+            copy_bulk(dest, src, count);
+        } else if (dst != s) {
+            memcpy(dest, src, count);
         }
+    } else {
+        copy_backward(dest, src, count);
     }
     
     return dest;
@@ -384,60 +1180,385 @@ void get_memory_info(mem_info_t* info) {
     
     // Report actual physical memory rather than limited memory
     info->total_memory = physical_mem_size;
-    info->free_memory = free_frames * PAGE_SIZE;
-    info->used_memory = physical_mem_size - (free_frames * PAGE_SIZE);
+    info->free_memory = ((uint64_t)free_frames + high_free_frames) << 12;
+    info->used_memory = physical_mem_size - info->free_memory;
+    info->high_memory = (uint64_t)high_usable_frames << 12;
+    info->high_free_memory = (uint64_t)high_free_frames << 12;
     info->reserved_memory = reserved_end;
     
-    // Count allocated blocks
-    uint32_t used_blocks = 0;
-    uint32_t largest_free_block = 0;
-    uint32_t fragmentation = 0;
+    info->peak_used_memory = peak_used_frames * PAGE_SIZE;
     
-    // Simply set to default values for now
-    info->block_count = used_blocks;
-    info->largest_free_block = largest_free_block;
-    info->fragmentation_count = fragmentation;
+    // Everything below comes from counters kept on each alloc/free
+    heap_stats_t heap;
+    kmalloc_get_stats(&heap);
+    info->block_count = heap.live_objects;
+    
+    // The buddy lists hold maximal free blocks, so the highest non-empty
+    // order is the largest run alloc_pages() can hand out
+    info->largest_free_block = 0;
+    info->fragmentation_count = 0;
+    for (uint32_t z = 0; z < ZONE_HIGH; z++) {
+        for (int32_t order = MAX_PAGE_ORDER; order >= 0; order--) {
+            if (zones[z].free_area_count[order] > 0) {
+                if ((PAGE_SIZE << order) > info->largest_free_block) {
+                    info->largest_free_block = PAGE_SIZE << order;
+                }
+                break;
+            }
+        }
+        info->fragmentation_count += zones[z].free_area_count[0];
+    }
 }
 
-// Allocate a physical frame
-void* alloc_frame() {
-    // Find a free frame using our bitmap
-    int32_t frame = bitmap_first_free();
+void mm_get_zone_info(uint32_t zone, zone_info_t* info) {
+    if (info == NULL || zone >= MAX_ZONES) {
+        return;
+    }
+    
+    info->name = zone_names[zone];
+    if (zone == ZONE_HIGH) {
+        info->usable_frames = high_usable_frames;
+        info->free_frames = high_free_frames;
+    } else {
+        info->usable_frames = zones[zone].usable_frames;
+        info->free_frames = zones[zone].free_frames;
+    }
+}
+
+// Track the physical high-water mark after frames were handed out
+static inline void note_frames_used(void) {
+    uint32_t used = usable_frames - free_frames;
+    if (used > peak_used_frames) {
+        peak_used_frames = used;
+    }
+}
+
+// Take one frame from a zone's part of the bitmap; -1 if it has none
+static int32_t zone_take_frame(uint32_t zone_index) {
+    zone_t* zone = &zones[zone_index];
+    int32_t frame = bitmap_find_free(zone);
     if (frame == -1) {
-        return NULL; // No free frames
+        return -1;
     }
     
-    // Mark frame as used
+    // Detach it from its buddy block and mark it as used
+    buddy_carve_frame(frame);
     bitmap_set(frame);
     
-    // Decrement free frames count
+    zone->free_frames--;
     free_frames--;
+    note_frames_used();
+    return frame;
+}
+
+// Take a frame from the zone or, failing that, the ones below it
+static int32_t zones_take_frame(uint32_t zone) {
+    for (int32_t z = zone; z >= 0; z--) {
+        int32_t frame = zone_take_frame(z);
+        if (frame != -1) {
+            return frame;
+        }
+    }
+    return -1;
+}
+
+// Take a frame from high memory; 0 if it is exhausted or absent
+static phys_addr_t high_take_frame(void) {
+    if (high_free_frames == 0) {
+        return 0;
+    }
     
-    // Calculate physical address
-    uint32_t phys_addr = frame * PAGE_SIZE + MB(1);
-    return (void*)phys_addr;
+    for (uint32_t n = 0; n < high_bitmap_words; n++) {
+        uint32_t word = high_next_word;
+        if (high_bitmap[word] != 0xFFFFFFFF) {
+            uint32_t bit = __builtin_ctz(~high_bitmap[word]);
+            high_bitmap[word] |= 1UL << bit;
+            high_free_frames--;
+            return MAX_PHYS_ADDR + ((phys_addr_t)(word * 32 + bit) << 12);
+        }
+        if (++high_next_word == high_bitmap_words) {
+            high_next_word = 0;
+        }
+    }
+    return 0;
 }
 
-// Free a physical frame
-void free_frame(void* frame) {
-    // Calculate frame number
-    uint32_t phys_addr = (uint32_t)frame;
+phys_addr_t alloc_frame_zone(uint32_t zone) {
+    if (bitmap == NULL || zone >= MAX_ZONES) {
+        return 0;
+    }
     
-    // Check if address is within our memory range
-    if (phys_addr < MB(1) || phys_addr >= total_mem_size) {
-        return; // Invalid address
+    if (zone == ZONE_HIGH) {
+        phys_addr_t frame = high_take_frame();
+        if (frame != 0) {
+            return frame;
+        }
+        zone = ZONE_NORMAL;
     }
     
-    uint32_t frame_num = (phys_addr - MB(1)) / PAGE_SIZE;
+    int32_t frame = zones_take_frame(zone);
+    if (frame == -1) {
+        // Out of free frames: the zero pool is the next reserve, as long as
+        // the frame on top lies in a zone the caller can take
+        if (zero_pool_count > 0 &&
+            (zone != ZONE_DMA || (uint32_t)zero_pool[zero_pool_count - 1] < ZONE_DMA_LIMIT)) {
+            return (uint32_t)zero_pool[--zero_pool_count];
+        }
+        
+        // Then compress cold demand-zero pages. zram may itself want a
+        // frame for a new zspage, which must not recurse into reclaim.
+        if (!reclaiming) {
+            reclaiming = TRUE;
+            uint32_t evicted = vm_reclaim(RECLAIM_BATCH);
+            reclaiming = FALSE;
+            if (evicted > 0) {
+                frame = zones_take_frame(zone);
+            }
+        }
+        if (frame == -1) {
+            return 0; // No free frames
+        }
+    }
     
-    // Check if frame is currently marked as used
-    if (bitmap_test(frame_num)) {
-        bitmap_clear(frame_num);
-        free_frames++;
+    return (phys_addr_t)frame * PAGE_SIZE;
+}
+
+// Allocate a physical frame, keeping the DMA zone for last
+void* alloc_frame() {
+    return (void*)(uint32_t)alloc_frame_zone(ZONE_NORMAL);
+}
+
+// Allocate a frame that reads as all zeroes, from the pool when possible
+void* alloc_zeroed_frame(void) {
+    if (zero_pool_count > 0) {
+        zero_pool_hits++;
+        return zero_pool[--zero_pool_count];
+    }
+    
+    zero_pool_misses++;
+    void* frame = alloc_frame();
+    if (frame != NULL) {
+        memset(frame, 0, PAGE_SIZE);
+    }
+    return frame;
+}
+
+// Zero a few frames into the pool; called while the system is idle.
+// Returns TRUE while there is more work left.
+boolean mm_idle_work(void) {
+    for (uint32_t i = 0; i < ZERO_POOL_BATCH && zero_pool_count < ZERO_POOL_SIZE; i++) {
+        // Leave the last free frames to real allocations, and the DMA zone
+        // to the devices that need it
+        if (zones[ZONE_NORMAL].free_frames <= ZERO_POOL_SIZE) {
+            return FALSE;
+        }
+        
+        int32_t frame = zone_take_frame(ZONE_NORMAL);
+        if (frame == -1) {
+            return FALSE;
+        }
+        memset((void*)(frame * PAGE_SIZE), 0, PAGE_SIZE);
+        zero_pool[zero_pool_count++] = (void*)(frame * PAGE_SIZE);
     }
+    return zero_pool_count < ZERO_POOL_SIZE;
+}
+
+void mm_get_zero_pool_stats(uint32_t* pooled, uint32_t* hits, uint32_t* misses) {
+    if (pooled) *pooled = zero_pool_count;
+    if (hits) *hits = zero_pool_hits;
+    if (misses) *misses = zero_pool_misses;
+}
+
+// Free a physical frame
+void free_frame(void* frame) {
+    free_pages(frame, 0);
 }
 
 // Get the number of free frames
 uint32_t get_free_frames() {
     return free_frames;
-}
\ No newline at end of file
+}
+
+// Take a frame from high memory, keeping the identity-mapped RAM for the
+// kernel's own structures
+phys_addr_t alloc_high_frame(void) {
+    return alloc_frame_zone(ZONE_HIGH);
+}
+
+void free_high_frame(phys_addr_t frame) {
+    if (frame < MAX_PHYS_ADDR) {
+        free_frame((void*)(uint32_t)frame);
+        return;
+    }
+    
+    uint32_t index = (uint32_t)((frame - MAX_PHYS_ADDR) >> 12);
+    if (index / 32 >= high_bitmap_words || !(high_bitmap[index / 32] & (1UL << (index % 32)))) {
+        return; // Out of range or already free
+    }
+    high_bitmap[index / 32] &= ~(1UL << (index % 32));
+    high_free_frames++;
+}
+
+// Allocate 2^order physically contiguous frames aligned to their own size,
+// from the zone or the ones below it
+void* alloc_pages_zone(uint32_t order, uint32_t zone) {
+    if (bitmap == NULL || order > MAX_PAGE_ORDER || zone >= MAX_ZONES) {
+        return NULL;
+    }
+    
+    // High memory has no buddy lists, and runs must be identity mapped anyway
+    if (zone == ZONE_HIGH) {
+        zone = ZONE_NORMAL;
+    }
+    
+    for (int32_t z = zone; z >= 0; z--) {
+        zone_t* area = &zones[z];
+        
+        // Smallest order with a free block that is big enough
+        uint32_t current = order;
+        while (current <= MAX_PAGE_ORDER && area->free_areas[current] == NULL) {
+            current++;
+        }
+        if (current > MAX_PAGE_ORDER) {
+            continue; // No run of this size in this zone
+        }
+        
+        uint32_t frame = (uint32_t)area->free_areas[current] / PAGE_SIZE;
+        buddy_remove(frame, current);
+        
+        // Split, handing the upper halves back until the block has the right size
+        while (current > order) {
+            current--;
+            buddy_insert(frame + (1UL << current), current);
+        }
+        
+        uint32_t count = 1UL << order;
+        bitmap_set_run(frame, count);
+        area->free_frames -= count;
+        free_frames -= count;
+        note_frames_used();
+        
+        return (void*)(frame * PAGE_SIZE);
+    }
+    
+    return NULL;
+}
+
+void* alloc_pages(uint32_t order) {
+    return alloc_pages_zone(order, ZONE_NORMAL);
+}
+
+// Free a run previously returned by alloc_pages() with the same order
+void free_pages(void* addr, uint32_t order) {
+    uint32_t phys_addr = (uint32_t)addr;
+    
+    // Check the run is aligned and inside our memory range
+    if (bitmap == NULL || order > MAX_PAGE_ORDER ||
+        (phys_addr & ((PAGE_SIZE << order) - 1)) != 0) {
+        return; // Invalid address
+    }
+    
+    uint32_t frame = phys_addr / PAGE_SIZE;
+    uint32_t count = 1UL << order;
+    if (frame + count > total_frames || !frame_run_used(frame, count)) {
+        return; // Out of range or already free
+    }
+    
+    for (uint32_t i = frame; i < frame + count; i++) {
+        bitmap_clear(i);
+    }
+    zone_of(frame)->free_frames += count;
+    free_frames += count;
+    
+    buddy_release(frame, order);
+}
+
+/* Frame allocator microbenchmark */
+typedef struct {
+    uint32_t first;     // First frame of a run allocated while filling
+    uint32_t count;     // Frames in the run
+} bench_run_t;
+
+// Fill memory to the given occupancy with alloc_frame(), then time
+// BENCH_ALLOCS further allocations. Returns nanoseconds per allocation.
+static uint32_t bench_at_occupancy(uint32_t percent, bench_run_t* runs) {
+    uint32_t target_used = usable_frames / 100 * percent;
+    uint32_t nruns = 0;
+    
+    // Fill from the bottom, remembering the frames as contiguous runs
+    zones_rewind();
+    while (usable_frames - free_frames < target_used) {
+        void* frame = alloc_frame();
+        if (frame == NULL) {
+            break;
+        }
+        
+        uint32_t n = (uint32_t)frame / PAGE_SIZE;
+        if (nruns > 0 && runs[nruns - 1].first + runs[nruns - 1].count == n) {
+            runs[nruns - 1].count++;
+        } else if (nruns < BENCH_MAX_RUNS) {
+            runs[nruns].first = n;
+            runs[nruns].count = 1;
+            nruns++;
+        } else {
+            free_frame(frame);
+            break;
+        }
+    }
+    
+    // Restart the search at frame 0 so every allocation pays for the walk
+    // over the used prefix, which is what the summary level is there to bound
+    void* timed[BENCH_ALLOCS];
+    uint32_t done = 0;
+    zones_rewind();
+    
+    uint64_t start = read_tsc();
+    for (done = 0; done < BENCH_ALLOCS; done++) {
+        timed[done] = alloc_frame();
+        if (timed[done] == NULL) {
+            break;
+        }
+    }
+    uint64_t end = read_tsc();
+    
+    for (uint32_t i = 0; i < done; i++) {
+        free_frame(timed[i]);
+    }
+    for (uint32_t i = 0; i < nruns; i++) {
+        for (uint32_t j = 0; j < runs[i].count; j++) {
+            free_frame((void*)((runs[i].first + j) * PAGE_SIZE));
+        }
+    }
+    
+    if (done == 0) {
+        return 0;
+    }
+    return timer_cycles_to_ns((uint32_t)(end - start)) / done;
+}
+
+// Report ns/alloc for alloc_frame() at 10%, 50% and 90% occupancy
+void mm_benchmark(void) {
+    static const uint32_t levels[] = { 10, 50, 90 };
+    
+    bench_run_t* runs = (bench_run_t*)kmalloc(BENCH_MAX_RUNS * sizeof(bench_run_t));
+    if (runs == NULL) {
+        print_string("Frame allocator benchmark skipped: out of memory\n");
+        return;
+    }
+    
+    // The fills below are synthetic; keep them out of the high-water mark
+    uint32_t saved_peak = peak_used_frames;
+    
+    print_string("Frame allocator benchmark (ns/alloc):");
+    for (uint32_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        uint32_t ns = bench_at_occupancy(levels[i], runs);
+        print_string("  ");
+        print_int(levels[i]);
+        print_string("%: ");
+        print_int(ns);
+    }
+    print_string("\n");
+    
+    kfree(runs);
+    peak_used_frames = saved_peak;
+}
@@ -2,6 +2,7 @@
 #define MM_H
 
 #include "data/types.h"
+#include "screen.h" // For boolean type
 
 // Memory management return codes
 #define MM_SUCCESS      0
@@ -10,38 +11,130 @@
 
 // Memory constants - optimized for smaller memory footprint
 #define PAGE_SIZE       4096UL   // 4KB pages
-#define HEAP_START      0x200000UL // Start heap at 2MB (reduced from 3MB)
+#define HEAP_START      0xC4000000UL // General-purpose heap (virtual, kernel half)
 #define HEAP_INITIAL    0x8000UL   // 32KB initial heap size (reduced from 1MB)
 #define HEAP_MAX        0x400000UL // 4MB maximum heap size
 #define BLOCKS_PER_BYTE 8        // 8 blocks per byte (1 bit per block)
 #define BLOCK_SIZE      16       // 16 bytes per allocation block
+#define MAX_PAGE_ORDER  10       // Largest contiguous run: 2^10 pages (4MB)
+#define KERNEL_VIRTUAL_BASE 0xC0000000UL // Kernel image is linked here (see linker.ld)
+#define BOOT_WINDOW_SIZE 0x1000000UL  // Kernel half mapped by the boot directory (kernel_entry.asm)
+#define MAX_HIGH_ADDR   (64ULL << 30)  // PAE reaches 36 physical address bits
+
+// Physical addresses are 64-bit under PAE; frame numbers still fit in 32 bits
+typedef uint64_t phys_addr_t;
+
+// Physical memory zones. A request for a zone is served from it or, once it
+// is exhausted, from the zones below it; plain alloc_frame() asks for
+// ZONE_NORMAL, so DMA-capable memory is used last. Every frame below
+// ZONE_HIGH is under 4GB and reachable by 32-bit devices.
+#define ZONE_DMA        0        // Below 16MB, for ISA DMA
+#define ZONE_NORMAL     1        // Identity-mapped RAM up to the kernel half
+#define ZONE_HIGH       2        // Above the identity map, reached with kmap()
+#define MAX_ZONES       3
+#define ZONE_DMA_LIMIT  0x1000000UL  // 16MB
+
+typedef struct {
+    const char* name;
+    uint32_t usable_frames;     // Frames backed by usable RAM
+    uint32_t free_frames;
+} zone_info_t;
+
+// Physical memory map (from the boot loader)
+#define MAX_MEM_REGIONS     32
+#define MEM_REGION_USABLE   1        // Same numbering as Multiboot memory map types
+#define MEM_REGION_RESERVED 2
+#define MEM_REGION_ACPI     3
+#define MEM_REGION_NVS      4
+#define MEM_REGION_BAD      5
+
+typedef struct {
+    uint64_t base;              // Physical start address
+    uint64_t length;            // Length in bytes
+    uint32_t type;              // MEM_REGION_* type
+} mem_region_t;
+
+// Kernel heap statistics, kept up to date on every kmalloc/kfree
+#define HEAP_SIZE_CLASSES 14
+
+typedef struct {
+    uint32_t object_size;       // Bytes per object in this class
+    uint32_t slabs;             // Slabs owned by the class (including a cached empty one)
+    uint32_t in_use;            // Objects handed out
+    uint32_t capacity;          // Objects the owned slabs can hold
+} heap_class_stats_t;
+
+typedef struct {
+    uint32_t live_objects;      // Blocks currently allocated
+    uint32_t live_bytes;        // Bytes held by them (slab objects count their class size)
+    uint32_t large_objects;     // Of those, page-backed allocations
+    uint32_t general_objects;   // Of those, blocks in the general-purpose heap
+    uint32_t general_mapped;    // Bytes the general-purpose heap has mapped
+    uint32_t general_free;      // Bytes of that in free blocks
+    uint32_t heap_pages;        // Frames owned by the heap
+    uint32_t peak_objects;      // High-water marks since boot
+    uint32_t peak_bytes;
+    uint32_t peak_pages;
+    heap_class_stats_t classes[HEAP_SIZE_CLASSES];
+} heap_stats_t;
 
 // Memory info structure - enhanced with additional fields
 typedef struct {
-    uint32_t total_memory;      // Total physical memory in bytes
-    uint32_t free_memory;       // Free physical memory in bytes
-    uint32_t used_memory;       // Used physical memory in bytes
+    uint64_t total_memory;      // Total physical memory in bytes
+    uint64_t free_memory;       // Free physical memory in bytes
+    uint64_t used_memory;       // Used physical memory in bytes
+    uint64_t high_memory;       // Of total_memory, RAM above the identity map
+    uint64_t high_free_memory;  // Of free_memory, free high RAM
     uint32_t reserved_memory;   // Reserved (unavailable) memory in bytes
-    uint32_t block_count;       // Number of allocated blocks
-    uint32_t largest_free_block; // Size of largest contiguous free block
-    uint32_t fragmentation_count; // Count of small isolated free blocks
+    uint32_t block_count;       // Number of allocated heap blocks
+    uint32_t largest_free_block; // Size of largest free buddy block in bytes
+    uint32_t fragmentation_count; // Count of isolated free frames (order-0 buddy blocks)
+    uint32_t peak_used_memory;  // High-water mark of used physical memory
 } mem_info_t;
 
-// Initialization 
-int mm_init(uint32_t mem_size);
+// Initialization (mboot_info_addr may be 0 to fall back to mem_size)
+int mm_init(uint32_t mem_size, uint32_t mboot_info_addr);
+uint32_t mm_get_regions(const mem_region_t** regions);
+uint32_t mm_get_phys_top(void);             // End of the highest RAM frame we track
 
 // Physical memory management
 void* alloc_frame();
 void free_frame(void* frame);
 uint32_t get_free_frames();
+void* alloc_pages(uint32_t order);          // 2^order contiguous frames, naturally aligned
+phys_addr_t alloc_frame_zone(uint32_t zone); // One frame from zone or below; 0 when out of memory
+void* alloc_pages_zone(uint32_t order, uint32_t zone); // ZONE_HIGH is treated as ZONE_NORMAL
+void mm_get_zone_info(uint32_t zone, zone_info_t* info);
+void* alloc_zeroed_frame(void);             // Prefers the pre-zeroed pool
+boolean mm_idle_work(void);                 // Refill the zeroed pool; TRUE if more to do
+void mm_get_zero_pool_stats(uint32_t* pooled, uint32_t* hits, uint32_t* misses);
+void free_pages(void* addr, uint32_t order);
 
-// Heap memory management
+// Frames above the identity map (reach them with kmap), alloc_frame_zone(ZONE_HIGH).
+// Falls back to a low frame when high memory is exhausted or absent; returns
+// 0 when out of memory.
+phys_addr_t alloc_high_frame(void);
+void free_high_frame(phys_addr_t frame);    // Takes low frames too (passes them to free_frame)
+
+// Heap memory management (slab caches for small objects, pages for large ones)
 void* kmalloc(size_t size);
 void* kcalloc(size_t nmemb, size_t size);
 void* krealloc(void* ptr, size_t size);
 void kfree(void* ptr);
+uint32_t kmalloc_footprint(void);           // Bytes of frames currently owned by the heap
+void kmalloc_get_stats(heap_stats_t* stats);
+
+// General-purpose heap at HEAP_START (boundary tags, grows up to HEAP_MAX).
+// kmalloc uses it for requests too big for a slab; usable once paging is on.
+void* heap_alloc(size_t size);
+boolean heap_free(void* ptr);               // FALSE (nothing freed) on a bad or double free
+boolean heap_owns(const void* ptr);
+size_t heap_usable_size(const void* ptr);
+uint32_t heap_mapped_bytes(void);
+uint32_t heap_free_bytes(void);
 
-// Memory operations
+// Memory operations (variant chosen from CPU features by mm_select_memops)
+void mm_select_memops(void);
 void* memset(void* dest, int value, size_t count);
 void* memcpy(void* dest, const void* src, size_t count);
 void* memmove(void* dest, const void* src, size_t count);
@@ -51,13 +144,33 @@ int memcmp(const void* s1, const void* s2, size_t count);
 void get_memory_info(mem_info_t* info);
 void mm_dump_stats();
 void mm_dump_stats_with_unit(int unit);
+void mm_dump_verbose(void);                 // Size classes, free block histogram, peaks
+void mm_benchmark(void);                    // Time alloc_frame() at 10/50/90% occupancy
+
+// CPU features recorded at boot by kernel_entry.asm
+extern uint32_t cpu_features;               // CPUID leaf 1 EDX
+extern uint32_t cpu_features_ext;           // CPUID leaf 7 EBX
+
+#define CPU_FEATURE_PSE      (1UL << 3)     // cpu_features bits
+#define CPU_FEATURE_PAE      (1UL << 6)
+#define CPU_FEATURE_PGE      (1UL << 13)
+#define CPU_FEATURE_PAT      (1UL << 16)
+#define CPU_FEATURE_FXSR     (1UL << 24)
+#define CPU_FEATURE_SSE      (1UL << 25)
+#define CPU_FEATURE_SSE2     (1UL << 26)
+#define CPU_FEATURE_EXT_ERMS (1UL << 9)     // cpu_features_ext: fast rep movsb/stosb
 
 // Assembly-implemented functions for hardware-specific memory operations
 uint32_t asm_verify_memory_size(uint32_t suggested_size);
 void asm_invalidate_page(uint32_t addr);
 void asm_flush_tlb(void);
+void asm_flush_tlb_global(void);            // Also drops global (PGE) entries
+void asm_load_page_directory(uint32_t phys_addr);
+void asm_enable_pae(uint32_t pdpt_phys, uint32_t cr4_bits); // Leaves paging on
+void asm_set_pat(uint32_t low, uint32_t high);
 
 // Helper functions
 void int_to_str(uint32_t num, char* str);
+void print_padded(uint32_t value, uint32_t width); // Right-aligned in a column
 
 #endif // MM_H
\ No newline at end of file
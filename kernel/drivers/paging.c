@@ -0,0 +1,768 @@
+#include "paging.h"
+#include "mm.h"
+#include "zram.h"
+#include "timer.h"
+#include "screen.h"
+#include "data/types.h"
+#include "interrupts/interrupt.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * PAE paging structure layout.
+ *
+ * CR3 points at a 4-entry page directory pointer table, one entry per GB of
+ * virtual space. Each page directory and page table is one frame of 512
+ * 64-bit entries, so a directory entry covers 2MB and a table entry 4KB.
+ * All four directories are created up front: PDPT entries are only read on
+ * a CR3 load and never change afterwards.
+ */
+#define PDPT_ENTRIES       4
+#define PAGE_DIR_ENTRIES   512
+#define PAGE_TABLE_ENTRIES 512
+#define PDPT_INDEX(virt)   ((virt) >> 30)
+#define PDE_INDEX(virt)    (((virt) >> 21) & 0x1FF)
+#define PTE_INDEX(virt)    (((virt) >> 12) & 0x1FF)
+#define PAGE_FRAME_MASK    0xFFFFF000UL              // Virtual addresses
+#define LARGE_FRAME_MASK   0xFFE00000UL
+#define PAGE_ADDR_MASK     0x000FFFFFFFFFF000ULL     // Physical address in an entry
+#define LARGE_ADDR_MASK    0x000FFFFFFFE00000ULL
+#define PAGE_FLAGS_MASK    0x00000FFFUL
+
+#define CR4_PGE            0x00000080  // Page Global Enable
+
+// IA32_PAT with entry 1 turned into write-combining; the rest keep their
+// power-on types (WB, WT, UC-, UC)
+#define PAT_LOW            0x00070106  // PA0 WB, PA1 WC, PA2 UC-, PA3 UC
+#define PAT_HIGH           0x00070406  // PA4 WB, PA5 WT, PA6 UC-, PA7 UC
+
+// Physical end of the kernel image (defined in linker.ld)
+extern uint8_t kernel_end[];
+
+// More pending invalidations than this and one CR3 reload is cheaper
+#define TLB_BATCH_MAX      32
+
+// Page fault error code bits
+#define PF_PRESENT         0x01  // Protection violation on a present page
+#define PF_USER            0x04  // Fault came from user mode
+#define PF_RESERVED        0x08  // Reserved bit set in a paging entry
+
+// A not-present PTE with this (CPU-ignored) bit holds a zram handle above
+// bit 12 instead of a frame
+#define PAGE_COMPRESSED    0x200
+
+// Forward declaration for print_int from shell.c
+extern void print_int(int num);
+
+/* Paging state */
+static uint64_t* pdpt = NULL;                      // Page directory pointer table
+static uint64_t* page_dirs[PDPT_ENTRIES];          // Its four directories (identity mapped)
+static boolean paging_on = FALSE;
+static boolean pge_supported = FALSE;
+static boolean pat_supported = FALSE;
+
+/* Temporary mappings (one bit per KMAP_BASE slot) */
+static uint32_t kmap_used[KMAP_SLOTS / 32];
+
+/* TLB invalidation batching */
+static uint32_t tlb_pending[TLB_BATCH_MAX];
+static uint32_t tlb_pending_count = 0;
+static boolean tlb_flush_all = FALSE;
+static uint32_t tlb_batch_depth = 0;
+
+/* Demand-zero regions */
+typedef struct {
+    uint32_t start;             // First byte (page aligned)
+    uint32_t end;               // One past the last byte (page aligned)
+    uint32_t flags;             // PAGE_* flags for frames faulted in
+    uint32_t committed;         // Pages currently backed by a frame
+    uint32_t compressed;        // Pages evicted to zram
+} vm_region_t;
+
+static vm_region_t vm_regions[MAX_VM_REGIONS];  // Sorted by start address
+static uint32_t vm_region_count = 0;
+static uint32_t minor_faults = 0;
+static uint32_t major_faults = 0;               // Pages brought back from zram
+static uint32_t reclaim_hand = VM_LAZY_BASE;    // Where the reclaim clock resumes
+
+// Remember that the translation for virt is stale
+static void tlb_queue(uint32_t virt) {
+    // Nothing is cached before paging is on, and a full flush covers everything
+    if (!paging_on || tlb_flush_all) {
+        return;
+    }
+
+    if (tlb_pending_count == TLB_BATCH_MAX) {
+        tlb_flush_all = TRUE;
+        return;
+    }
+    tlb_pending[tlb_pending_count++] = virt;
+}
+
+static void tlb_commit(void) {
+    if (tlb_flush_all) {
+        // A CR3 reload keeps global entries, and kernel mappings are global
+        if (pge_supported) {
+            asm_flush_tlb_global();
+        } else {
+            asm_flush_tlb();
+        }
+    } else {
+        for (uint32_t i = 0; i < tlb_pending_count; i++) {
+            asm_invalidate_page(tlb_pending[i]);
+        }
+    }
+
+    tlb_pending_count = 0;
+    tlb_flush_all = FALSE;
+}
+
+static inline void tlb_batch_begin(void) {
+    tlb_batch_depth++;
+}
+
+static inline void tlb_batch_end(void) {
+    if (--tlb_batch_depth == 0) {
+        tlb_commit();
+    }
+}
+
+// Everything in the kernel half is shared by all address spaces, so it is
+// mapped global and survives CR3 switches
+static inline uint32_t global_flag(uint32_t virt) {
+    return (pge_supported && virt >= KERNEL_VIRTUAL_BASE) ? PAGE_GLOBAL : 0;
+}
+
+/* Page table helpers */
+static uint64_t* alloc_page_table(void) {
+    return (uint64_t*)alloc_zeroed_frame();
+}
+
+// Entries are 64-bit but the CPU stores 32 bits at a time. Keep the entry
+// not-present while its high half changes so the page walker never sees a
+// torn address.
+static inline void set_entry(uint64_t* entry, uint64_t value) {
+    volatile uint32_t* half = (volatile uint32_t*)entry;
+    half[0] = 0;
+    half[1] = (uint32_t)(value >> 32);
+    half[0] = (uint32_t)value;
+}
+
+// Tables always come from low frames, so their physical address is usable
+static inline uint64_t* entry_table(uint64_t entry) {
+    return (uint64_t*)(uint32_t)(entry & PAGE_ADDR_MASK);
+}
+
+static inline uint64_t* pde_for(uint32_t virt) {
+    return &page_dirs[PDPT_INDEX(virt)][PDE_INDEX(virt)];
+}
+
+// Return the page table covering virt, creating it if asked. A 2MB page in
+// the way is split into an equivalent table of 4KB pages.
+static uint64_t* get_page_table(uint32_t virt, boolean create, uint32_t flags) {
+    uint64_t* pde = pde_for(virt);
+
+    if (*pde & PAGE_PRESENT) {
+        if (!(*pde & PAGE_LARGE)) {
+            return entry_table(*pde);
+        }
+        if (!create) {
+            return NULL;
+        }
+
+        uint64_t* table = alloc_page_table();
+        if (table == NULL) {
+            return NULL;
+        }
+
+        uint64_t base = *pde & LARGE_ADDR_MASK;
+        uint32_t entry_flags = (uint32_t)*pde & PAGE_FLAGS_MASK & ~PAGE_LARGE;
+        for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; i++) {
+            table[i] = (base + i * PAGE_SIZE) | entry_flags;
+        }
+
+        set_entry(pde, (uint32_t)table | PAGE_PRESENT | PAGE_WRITE | (entry_flags & PAGE_USER));
+        tlb_queue(virt); // Any address inside drops the 2MB entry
+        return table;
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    uint64_t* table = alloc_page_table();
+    if (table == NULL) {
+        return NULL;
+    }
+    set_entry(pde, (uint32_t)table | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER));
+    return table;
+}
+
+static int map_one(uint32_t virt, phys_addr_t phys, uint32_t flags) {
+    uint64_t* table = get_page_table(virt, TRUE, flags);
+    if (table == NULL) {
+        return MM_OUT_OF_MEM;
+    }
+
+    uint64_t* pte = &table[PTE_INDEX(virt)];
+    uint64_t old = *pte;
+    set_entry(pte, (phys & PAGE_ADDR_MASK) | (flags & PAGE_FLAGS_MASK) | global_flag(virt) |
+                   PAGE_PRESENT);
+
+    // Not-present entries are never cached, so only replacements need a flush
+    if (old & PAGE_PRESENT) {
+        tlb_queue(virt);
+    }
+    return MM_SUCCESS;
+}
+
+static void map_large(uint32_t virt, phys_addr_t phys, uint32_t flags) {
+    uint64_t* pde = pde_for(virt);
+    uint64_t old = *pde;
+    set_entry(pde, (phys & LARGE_ADDR_MASK) | (flags & PAGE_FLAGS_MASK) | global_flag(virt) |
+                   PAGE_PRESENT | PAGE_LARGE);
+
+    if (old & PAGE_PRESENT) {
+        if (old & PAGE_LARGE) {
+            tlb_queue(virt);
+        } else {
+            // A whole table of 4KB translations went away
+            free_frame(entry_table(old));
+            tlb_flush_all = paging_on;
+        }
+    }
+}
+
+static int unmap_one(uint32_t virt) {
+    if (!(*pde_for(virt) & PAGE_PRESENT)) {
+        return MM_ERROR;
+    }
+
+    uint64_t* table = get_page_table(virt, TRUE, 0);
+    if (table == NULL) {
+        return MM_OUT_OF_MEM;
+    }
+
+    uint64_t* pte = &table[PTE_INDEX(virt)];
+    if (!(*pte & PAGE_PRESENT)) {
+        return MM_ERROR;
+    }
+    set_entry(pte, 0);
+    tlb_queue(virt);
+    return MM_SUCCESS;
+}
+
+/* Public interface */
+int map_page(uint32_t virt, phys_addr_t phys, uint32_t flags) {
+    if (pdpt == NULL) {
+        return MM_ERROR;
+    }
+
+    tlb_batch_begin();
+    int result = map_one(virt & PAGE_FRAME_MASK, phys, flags);
+    tlb_batch_end();
+    return result;
+}
+
+int unmap_page(uint32_t virt) {
+    if (pdpt == NULL) {
+        return MM_ERROR;
+    }
+
+    tlb_batch_begin();
+    int result = unmap_one(virt & PAGE_FRAME_MASK);
+    tlb_batch_end();
+    return result;
+}
+
+int map_range(uint32_t virt, phys_addr_t phys, uint32_t size, uint32_t flags) {
+    if (pdpt == NULL) {
+        return MM_ERROR;
+    }
+
+    uint32_t pages = (size + (virt & ~PAGE_FRAME_MASK) + PAGE_SIZE - 1) / PAGE_SIZE;
+    virt &= PAGE_FRAME_MASK;
+    phys &= PAGE_ADDR_MASK;
+
+    int result = MM_SUCCESS;
+    tlb_batch_begin();
+    while (pages > 0) {
+        // Whole, aligned 2MB chunks become a single directory entry
+        if (pages >= PAGE_TABLE_ENTRIES && (virt & (LARGE_PAGE_SIZE - 1)) == 0 &&
+            ((uint32_t)phys & (LARGE_PAGE_SIZE - 1)) == 0) {
+            map_large(virt, phys, flags);
+            virt += LARGE_PAGE_SIZE;
+            phys += LARGE_PAGE_SIZE;
+            pages -= PAGE_TABLE_ENTRIES;
+            continue;
+        }
+
+        result = map_one(virt, phys, flags);
+        if (result != MM_SUCCESS) {
+            break;
+        }
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+        pages--;
+    }
+    tlb_batch_end();
+    return result;
+}
+
+int unmap_range(uint32_t virt, uint32_t size) {
+    if (pdpt == NULL) {
+        return MM_ERROR;
+    }
+
+    uint32_t pages = (size + (virt & ~PAGE_FRAME_MASK) + PAGE_SIZE - 1) / PAGE_SIZE;
+    virt &= PAGE_FRAME_MASK;
+
+    tlb_batch_begin();
+    while (pages > 0) {
+        uint64_t* pde = pde_for(virt);
+
+        // Drop whole 2MB pages without splitting them first
+        if ((*pde & PAGE_LARGE) && pages >= PAGE_TABLE_ENTRIES &&
+            (virt & (LARGE_PAGE_SIZE - 1)) == 0) {
+            set_entry(pde, 0);
+            tlb_queue(virt);
+            virt += LARGE_PAGE_SIZE;
+            pages -= PAGE_TABLE_ENTRIES;
+            continue;
+        }
+
+        unmap_one(virt); // Holes in the range are fine
+        virt += PAGE_SIZE;
+        pages--;
+    }
+    tlb_batch_end();
+    return MM_SUCCESS;
+}
+
+boolean paging_translate(uint32_t virt, phys_addr_t* phys) {
+    if (pdpt == NULL) {
+        return FALSE;
+    }
+
+    uint64_t pde = *pde_for(virt);
+    if (!(pde & PAGE_PRESENT)) {
+        return FALSE;
+    }
+
+    if (pde & PAGE_LARGE) {
+        if (phys) *phys = (pde & LARGE_ADDR_MASK) | (virt & (LARGE_PAGE_SIZE - 1));
+        return TRUE;
+    }
+
+    uint64_t pte = entry_table(pde)[PTE_INDEX(virt)];
+    if (!(pte & PAGE_PRESENT)) {
+        return FALSE;
+    }
+    if (phys) *phys = (pte & PAGE_ADDR_MASK) | (virt & ~PAGE_FRAME_MASK);
+    return TRUE;
+}
+
+/* Temporary mappings */
+void* kmap(phys_addr_t phys) {
+    // Low RAM is identity mapped already
+    if (phys < KERNEL_VIRTUAL_BASE) {
+        return (void*)(uint32_t)phys;
+    }
+    if (!paging_on) {
+        return NULL;
+    }
+
+    uint32_t flags = irq_save();
+    uint32_t slot = KMAP_SLOTS;
+    for (uint32_t word = 0; word < KMAP_SLOTS / 32; word++) {
+        if (kmap_used[word] != 0xFFFFFFFF) {
+            uint32_t bit = __builtin_ctz(~kmap_used[word]);
+            kmap_used[word] |= 1UL << bit;
+            slot = word * 32 + bit;
+            break;
+        }
+    }
+    irq_restore(flags);
+    if (slot == KMAP_SLOTS) {
+        return NULL;
+    }
+
+    // The window's page table exists from paging_init, so this cannot fail
+    uint32_t virt = KMAP_BASE + slot * PAGE_SIZE;
+    map_page(virt, phys, PAGE_WRITE);
+    return (void*)(virt + ((uint32_t)phys & ~PAGE_FRAME_MASK));
+}
+
+void kunmap(void* addr) {
+    uint32_t virt = (uint32_t)addr & PAGE_FRAME_MASK;
+    if (virt < KMAP_BASE || virt >= KMAP_BASE + KMAP_SLOTS * PAGE_SIZE) {
+        return;
+    }
+
+    unmap_page(virt);
+    uint32_t slot = (virt - KMAP_BASE) / PAGE_SIZE;
+    uint32_t flags = irq_save();
+    kmap_used[slot / 32] &= ~(1UL << (slot % 32));
+    irq_restore(flags);
+}
+
+/* Demand-zero regions */
+static vm_region_t* vm_find(uint32_t addr) {
+    for (uint32_t i = 0; i < vm_region_count; i++) {
+        if (addr >= vm_regions[i].start && addr < vm_regions[i].end) {
+            return &vm_regions[i];
+        }
+    }
+    return NULL;
+}
+
+void* vm_reserve(uint32_t size, uint32_t flags) {
+    if (pdpt == NULL || size == 0 || vm_region_count == MAX_VM_REGIONS) {
+        return NULL;
+    }
+
+    size = (size + PAGE_SIZE - 1) & PAGE_FRAME_MASK;
+
+    // First fit between the existing regions, each followed by an unmapped
+    // guard page so a running-off-the-end stack or buffer faults for real
+    uint32_t start = VM_LAZY_BASE;
+    uint32_t slot = 0;
+    while (slot < vm_region_count && vm_regions[slot].start - start < size + PAGE_SIZE) {
+        start = vm_regions[slot].end + PAGE_SIZE;
+        slot++;
+    }
+    if (start > VM_LAZY_END || VM_LAZY_END - start < size + PAGE_SIZE) {
+        return NULL;
+    }
+
+    for (uint32_t i = vm_region_count; i > slot; i--) {
+        vm_regions[i] = vm_regions[i - 1];
+    }
+    vm_regions[slot].start = start;
+    vm_regions[slot].end = start + size;
+    vm_regions[slot].flags = flags & (PAGE_WRITE | PAGE_USER | VM_PINNED);
+    vm_regions[slot].committed = 0;
+    vm_regions[slot].compressed = 0;
+    vm_region_count++;
+
+    return (void*)start;
+}
+
+// Page table entry for a 4KB-mapped address, or NULL if there is none
+static uint64_t* pte_lookup(uint32_t virt) {
+    uint64_t pde = *pde_for(virt);
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return NULL;
+    }
+    return &entry_table(pde)[PTE_INDEX(virt)];
+}
+
+void vm_release(void* base) {
+    uint32_t slot = 0;
+    while (slot < vm_region_count && vm_regions[slot].start != (uint32_t)base) {
+        slot++;
+    }
+    if (slot == vm_region_count) {
+        return;
+    }
+
+    // Hand back whatever was touched; untouched pages never had a frame
+    vm_region_t* region = &vm_regions[slot];
+    tlb_batch_begin();
+    for (uint32_t virt = region->start;
+         virt < region->end && (region->committed > 0 || region->compressed > 0);
+         virt += PAGE_SIZE) {
+        uint64_t* pte = pte_lookup(virt);
+        if (pte == NULL) {
+            continue;
+        }
+
+        uint64_t entry = *pte;
+        if (entry & PAGE_PRESENT) {
+            if (unmap_one(virt) == MM_SUCCESS) {
+                free_frame((void*)(uint32_t)(entry & PAGE_ADDR_MASK));
+                region->committed--;
+            }
+        } else if (entry & PAGE_COMPRESSED) {
+            zram_free((uint32_t)(entry >> 12));
+            set_entry(pte, 0);
+            region->compressed--;
+        }
+    }
+    tlb_batch_end();
+
+    vm_region_count--;
+    for (uint32_t i = slot; i < vm_region_count; i++) {
+        vm_regions[i] = vm_regions[i + 1];
+    }
+}
+
+// Next region at or after addr, wrapping to the first
+static vm_region_t* vm_next_region(uint32_t addr) {
+    for (uint32_t i = 0; i < vm_region_count; i++) {
+        if (addr < vm_regions[i].end) {
+            return &vm_regions[i];
+        }
+    }
+    return &vm_regions[0];
+}
+
+uint32_t vm_reclaim(uint32_t target) {
+    // A caller in the middle of changing mappings may hold stale TLB entries
+    // that kmap() slots would trip over, so only reclaim between updates
+    if (pdpt == NULL || vm_region_count == 0 || tlb_batch_depth > 0) {
+        return 0;
+    }
+
+    uint32_t flags = irq_save();
+
+    // Clock sweep: a page used since the hand last passed loses its accessed
+    // bit and is spared once. Two full turns find every cold page.
+    uint32_t budget = 0;
+    for (uint32_t i = 0; i < vm_region_count; i++) {
+        budget += (vm_regions[i].end - vm_regions[i].start) / PAGE_SIZE;
+    }
+    budget *= 2;
+
+    uint32_t reclaimed = 0;
+    while (reclaimed < target && budget > 0) {
+        vm_region_t* region = vm_next_region(reclaim_hand);
+        if (reclaim_hand < region->start || reclaim_hand >= region->end) {
+            reclaim_hand = region->start;
+        }
+        if (region->committed == 0 || (region->flags & VM_PINNED)) {
+            uint32_t pages = (region->end - reclaim_hand) / PAGE_SIZE;
+            budget = (budget > pages) ? budget - pages : 0;
+            reclaim_hand = region->end;
+            continue;
+        }
+
+        uint32_t virt = reclaim_hand;
+        reclaim_hand += PAGE_SIZE;
+        budget--;
+
+        uint64_t* pte = pte_lookup(virt);
+        if (pte == NULL || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+
+        // No invalidation: a cached translation only means the bit may not
+        // come back until the entry is evicted, which makes the page look
+        // colder than it is
+        if (*pte & PAGE_ACCESSED) {
+            set_entry(pte, *pte & ~(uint64_t)PAGE_ACCESSED);
+            continue;
+        }
+
+        phys_addr_t phys = *pte & PAGE_ADDR_MASK;
+        boolean donated;
+        uint32_t handle = zram_store((const void*)virt, phys, &donated);
+        if (handle == 0) {
+            continue;
+        }
+
+        set_entry(pte, ((uint64_t)handle << 12) | PAGE_COMPRESSED);
+        asm_invalidate_page(virt);
+        if (!donated) {
+            free_frame((void*)(uint32_t)phys);
+        }
+        region->committed--;
+        region->compressed++;
+        reclaimed++;
+    }
+
+    irq_restore(flags);
+    return reclaimed;
+}
+
+// Bring a page back from zram into a fresh frame
+static boolean vm_swap_in(vm_region_t* region, uint32_t virt, uint64_t* pte) {
+    uint64_t start = read_tsc();
+    uint32_t handle = (uint32_t)(*pte >> 12);
+
+    void* frame = alloc_frame();
+    if (frame == NULL) {
+        return FALSE;
+    }
+    if (!zram_load(handle, frame)) {
+        free_frame(frame);
+        return FALSE;
+    }
+
+    if (map_page(virt, (uint32_t)frame, region->flags) != MM_SUCCESS) {
+        free_frame(frame);
+        return FALSE;
+    }
+    zram_free(handle);
+
+    region->compressed--;
+    region->committed++;
+    major_faults++;
+    zram_note_fault((uint32_t)(read_tsc() - start));
+    return TRUE;
+}
+
+boolean paging_handle_fault(uint32_t addr, uint32_t err_code) {
+    // Only a missing page can be demand-zero; anything else is a real violation
+    if (pdpt == NULL || (err_code & (PF_PRESENT | PF_RESERVED))) {
+        return FALSE;
+    }
+
+    vm_region_t* region = vm_find(addr);
+    if (region == NULL || ((err_code & PF_USER) && !(region->flags & PAGE_USER))) {
+        return FALSE;
+    }
+
+    // Evicted earlier: decompress instead of handing out zeroes
+    uint64_t* pte = pte_lookup(addr);
+    if (pte != NULL && (*pte & PAGE_COMPRESSED)) {
+        return vm_swap_in(region, addr & PAGE_FRAME_MASK, pte);
+    }
+
+    void* frame = alloc_zeroed_frame();
+    if (frame == NULL) {
+        return FALSE;
+    }
+
+    // Not-present to present, so there is no stale TLB entry to drop
+    if (map_page(addr & PAGE_FRAME_MASK, (uint32_t)frame, region->flags) != MM_SUCCESS) {
+        free_frame(frame);
+        return FALSE;
+    }
+
+    region->committed++;
+    minor_faults++;
+    return TRUE;
+}
+
+void vm_get_stats(vm_stats_t* stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->regions = vm_region_count;
+    stats->reserved_bytes = 0;
+    stats->committed_bytes = 0;
+    stats->compressed_pages = 0;
+    for (uint32_t i = 0; i < vm_region_count; i++) {
+        stats->reserved_bytes += vm_regions[i].end - vm_regions[i].start;
+        stats->committed_bytes += vm_regions[i].committed * PAGE_SIZE;
+        stats->compressed_pages += vm_regions[i].compressed;
+    }
+    stats->minor_faults = minor_faults;
+    stats->major_faults = major_faults;
+}
+
+boolean paging_enabled(void) {
+    return paging_on;
+}
+
+boolean paging_write_combining(void) {
+    return paging_on && pat_supported;
+}
+
+// Build the PAE kernel page tables and switch to them: the kernel image at
+// KERNEL_VIRTUAL_BASE, RAM below it identity mapped, and the framebuffer
+// in FB_WINDOW_BASE.
+// Replaces the 2-level boot trampoline directory from kernel_entry.asm.
+int paging_init(void) {
+    if (paging_on) {
+        return MM_SUCCESS;
+    }
+
+    // Without PAE the kernel keeps running on the boot directory
+    if (!(cpu_features & CPU_FEATURE_PAE)) {
+        print_string("Paging: CPU has no PAE, keeping the boot mappings\n");
+        return MM_ERROR;
+    }
+    pge_supported = (cpu_features & CPU_FEATURE_PGE) != 0;
+    pat_supported = (cpu_features & CPU_FEATURE_PAT) != 0;
+
+    // One frame for the PDPT (CR3 needs it 32-byte aligned and below 4GB)
+    pdpt = alloc_page_table();
+    if (pdpt == NULL) {
+        return MM_OUT_OF_MEM;
+    }
+    for (uint32_t i = 0; i < PDPT_ENTRIES; i++) {
+        page_dirs[i] = alloc_page_table();
+        if (page_dirs[i] == NULL) {
+            return MM_OUT_OF_MEM;
+        }
+        pdpt[i] = (uint32_t)page_dirs[i] | PAGE_PRESENT;
+    }
+
+    // All tracked RAM, rounded up to whole 2MB pages (mm keeps it below
+    // the kernel half; anything above is reached through kmap)
+    uint32_t top = mm_get_phys_top();
+    top = (top + LARGE_PAGE_SIZE - 1) & LARGE_FRAME_MASK;
+    if (top > KERNEL_VIRTUAL_BASE) {
+        top = KERNEL_VIRTUAL_BASE;
+    }
+
+    // The kernel image: physical 0 up to kernel_end, seen from the higher half
+    uint32_t kernel_size = ((uint32_t)kernel_end + LARGE_PAGE_SIZE - 1) & LARGE_FRAME_MASK;
+    int result = map_range(KERNEL_VIRTUAL_BASE, 0, kernel_size, PAGE_WRITE);
+
+    // The first 2MB uses 4KB pages so page 0 can stay unmapped and catch
+    // NULL dereferences; everything above goes in 2MB pages
+    if (result == MM_SUCCESS) {
+        result = map_range(PAGE_SIZE, PAGE_SIZE, LARGE_PAGE_SIZE - PAGE_SIZE, PAGE_WRITE);
+    }
+    if (result == MM_SUCCESS && top > LARGE_PAGE_SIZE) {
+        result = map_range(LARGE_PAGE_SIZE, LARGE_PAGE_SIZE, top - LARGE_PAGE_SIZE, PAGE_WRITE);
+    }
+
+    // The linear framebuffer is MMIO outside RAM. It often sits at or above
+    // 0xC0000000, which is the kernel's, so it gets a window of its own
+    // rather than an identity mapping. The window keeps the offset within a
+    // 2MB page so large pages still line up. The console only ever writes
+    // it, so combining those writes into bursts beats the uncached type
+    // the firmware's MTRRs give it (PAT WC overrides MTRR UC).
+    uint32_t fb_size;
+    uint32_t fb = screen_get_framebuffer(&fb_size);
+    uint32_t fb_virt = FB_WINDOW_BASE + (fb & (LARGE_PAGE_SIZE - 1));
+    if (result == MM_SUCCESS && fb != 0) {
+        if (fb_size > FB_WINDOW_SIZE - (fb_virt - FB_WINDOW_BASE)) {
+            print_string("Paging: framebuffer does not fit its window\n");
+            result = MM_ERROR;
+        } else {
+            result = map_range(fb_virt, fb, fb_size,
+                               PAGE_WRITE | (pat_supported ? PAGE_WRITECOMBINE : 0));
+        }
+    }
+
+    // kmap() must not allocate, so its page table is made now
+    if (result == MM_SUCCESS && get_page_table(KMAP_BASE, TRUE, 0) == NULL) {
+        result = MM_OUT_OF_MEM;
+    }
+
+    if (result != MM_SUCCESS) {
+        return result;
+    }
+
+    // No live mapping uses PWT yet, so entry 1 can change before the switch
+    if (pat_supported) {
+        asm_set_pat(PAT_LOW, PAT_HIGH);
+    }
+
+    // CR4.PAE can only change with paging off; the switch runs from the
+    // identity-mapped .boot section and sets PGE on the way
+    asm_enable_pae((uint32_t)pdpt, pge_supported ? CR4_PGE : 0);
+    paging_on = TRUE;
+    if (fb != 0) {
+        screen_set_framebuffer_mapping((u32*)fb_virt);
+    }
+
+    print_string("Paging enabled (PAE): ");
+    print_int(top / (1024 * 1024));
+    print_string(" MB identity mapped with 2MB pages");
+    print_string(pge_supported ? ", kernel at 0xC0000000 (global)\n"
+                               : ", kernel at 0xC0000000\n");
+    if (pat_supported && fb != 0) {
+        print_string("Framebuffer mapped write-combining (PAT)\n");
+    }
+    return MM_SUCCESS;
+}
@@ -0,0 +1,107 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "data/types.h"
+#include "screen.h" // For boolean type
+#include "mm.h"     // For phys_addr_t
+
+// Page directory / page table entry flags (the low bits of the 64-bit PAE
+// entries; PDPT entries only take PAGE_PRESENT)
+#define PAGE_PRESENT      0x001
+#define PAGE_WRITE        0x002
+#define PAGE_USER         0x004
+#define PAGE_WRITETHROUGH 0x008
+#define PAGE_NOCACHE      0x010
+#define PAGE_ACCESSED     0x020
+#define PAGE_DIRTY        0x040
+#define PAGE_LARGE        0x080     // Directory entry maps a 2MB page
+#define PAGE_GLOBAL       0x100
+
+// Selects PAT entry 1, which paging_init reprograms from write-through to
+// write-combining. Only meaningful when paging_write_combining() is TRUE.
+#define PAGE_WRITECOMBINE PAGE_WRITETHROUGH
+
+#define LARGE_PAGE_SIZE   0x200000UL // 2MB
+
+// vm_reserve() flag, outside the PTE bits: pages stay resident and are
+// never evicted to zram
+#define VM_PINNED         0x1000
+
+/*
+ * Virtual address layout.
+ *
+ *   0x00001000 - 0xBFFFFFFF  RAM identity mapped (virtual == physical)
+ *   0xC0000000               Kernel image (global when the CPU has PGE)
+ *   0xC4000000               Kernel heap
+ *   0xC8000000 - 0xCFFFFFFF  Demand-zero reservations
+ *   0xD0000000               kmap slots
+ *   0xE0000000 - 0xEFFFFFFF  Linear framebuffer
+ *
+ * Only the kernel image moved to the higher half. Frame allocators hand out
+ * physical addresses that callers dereference directly, so the low 3GB
+ * stays an identity map of RAM and is not yet free for per-process address
+ * spaces. That needs every frame user converted through a physmap window
+ * in the kernel half first.
+ */
+
+// Kernel virtual window for demand-zero reservations
+#define VM_LAZY_BASE      0xC8000000UL
+#define VM_LAZY_END       0xD0000000UL
+#define MAX_VM_REGIONS    16
+
+// Window of temporary mappings for frames outside the identity map
+#define KMAP_BASE         0xD0000000UL
+#define KMAP_SLOTS        256
+
+// Kernel virtual window the linear framebuffer is mapped into, wherever
+// its physical address lies
+#define FB_WINDOW_BASE    0xE0000000UL
+#define FB_WINDOW_SIZE    0x10000000UL
+
+// Demand-zero statistics
+typedef struct {
+    uint32_t regions;           // Live reservations
+    uint32_t reserved_bytes;    // Virtual space reserved
+    uint32_t committed_bytes;   // Of that, backed by frames
+    uint32_t compressed_pages;  // Evicted to zram, decompressed on next touch
+    uint32_t minor_faults;      // Pages faulted in since boot
+    uint32_t major_faults;      // Pages decompressed back from zram
+} vm_stats_t;
+
+// Build the PAE kernel page tables and switch to them (needs CPUID PAE)
+int paging_init(void);
+boolean paging_enabled(void);
+boolean paging_write_combining(void);   // Framebuffer mapped WC through the PAT
+
+// Map or unmap 4KB pages. Each call invalidates only the TLB entries it
+// changed; map_range/unmap_range batch their invalidations and use 2MB
+// pages wherever both addresses are 2MB aligned.
+int map_page(uint32_t virt, phys_addr_t phys, uint32_t flags);
+int unmap_page(uint32_t virt);
+int map_range(uint32_t virt, phys_addr_t phys, uint32_t size, uint32_t flags);
+int unmap_range(uint32_t virt, uint32_t size);
+
+// Look up the physical address behind a virtual one
+boolean paging_translate(uint32_t virt, phys_addr_t* phys);
+
+// Map any physical frame into the kernel. Identity-mapped RAM comes back
+// as is; anything else takes one of KMAP_SLOTS until kunmap(). NULL if the
+// window is full.
+void* kmap(phys_addr_t phys);
+void kunmap(void* addr);
+
+// Reserve kernel virtual space without committing frames. Each page gets a
+// zeroed frame on first touch; vm_release() returns the frames and the space.
+void* vm_reserve(uint32_t size, uint32_t flags);
+void vm_release(void* base);
+void vm_get_stats(vm_stats_t* stats);
+
+// Compress up to target reserved pages not touched since the last sweep
+// into zram, freeing their frames; returns how many were evicted
+uint32_t vm_reclaim(uint32_t target);
+
+// Called from the page fault handler; TRUE if the fault was a first touch of
+// a reserved page or a touch of an evicted one, and has been resolved
+boolean paging_handle_fault(uint32_t addr, uint32_t err_code);
+
+#endif // PAGING_H
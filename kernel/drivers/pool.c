@@ -0,0 +1,173 @@
+#include "pool.h"
+#include "mm.h"
+#include "interrupts/interrupt.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * Fixed-size object pools.
+ *
+ * Each pool carves naturally aligned frame runs from alloc_pages() into
+ * equally sized, aligned objects and runs the constructor on each of them
+ * once. Free objects are kept as pointers on a stack, so pool_get() and
+ * pool_put() are a bounds check and one load or store. Pages stay with the
+ * pool until pool_destroy().
+ */
+
+#define POOL_MIN_OBJECTS 8          // Grow the chunk until at least this many objects fit
+#define POOL_MAX_ORDER   4          // Chunks are at most 16 pages (64KB)
+
+#define POOL_CHUNK_HEADER sizeof(pool_chunk_t)
+
+static inline uint32_t align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// First object offset in a chunk, past the header
+static inline uint32_t first_object(const pool_t* pool) {
+    return align_up(POOL_CHUNK_HEADER, pool->align);
+}
+
+// Add one chunk of constructed objects to the pool
+static int pool_grow(pool_t* pool) {
+    // Allocate everything up front so a failure leaves the pool unchanged
+    pool_chunk_t* chunk = (pool_chunk_t*)alloc_pages(pool->chunk_order);
+    if (chunk == NULL) {
+        return MM_OUT_OF_MEM;
+    }
+    chunk->order = pool->chunk_order;
+
+    // Push in reverse so objects come out in address order
+    uint8_t* base = (uint8_t*)chunk + first_object(pool);
+    for (uint32_t i = pool->per_chunk; i > 0; i--) {
+        void* obj = base + (i - 1) * pool->object_size;
+        if (pool->ctor) {
+            pool->ctor(obj);
+        }
+    }
+
+    // Only code running with interrupts on grows a pool, so the capacity
+    // cannot change under us; interrupt handlers just push and pop
+    uint32_t new_capacity = pool->capacity + pool->per_chunk;
+    void** stack = (void**)kmalloc(new_capacity * sizeof(void*));
+    if (stack == NULL) {
+        free_pages(chunk, chunk->order);
+        return MM_OUT_OF_MEM;
+    }
+
+    // Swap stacks with interrupts off so an ISR never sees a half-copied one
+    uint32_t flags = irq_save();
+    void** old_stack = pool->stack;
+    memcpy(stack, old_stack, pool->top * sizeof(void*));
+    pool->stack = stack;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    for (uint32_t i = pool->per_chunk; i > 0; i--) {
+        pool->stack[pool->top++] = base + (i - 1) * pool->object_size;
+    }
+    pool->capacity = new_capacity;
+    irq_restore(flags);
+
+    kfree(old_stack);
+    return MM_SUCCESS;
+}
+
+pool_t* pool_create(size_t size, size_t align, pool_ctor_t ctor) {
+    if (align == 0) {
+        align = POOL_CACHE_LINE;
+    }
+    if (size == 0 || (align & (align - 1)) != 0 || align > PAGE_SIZE) {
+        return NULL;
+    }
+
+    pool_t* pool = (pool_t*)kmalloc(sizeof(pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    pool->stack = NULL;
+    pool->top = 0;
+    pool->capacity = 0;
+    pool->object_size = align_up(size, align);
+    pool->align = align;
+    pool->ctor = ctor;
+    pool->chunks = NULL;
+
+    // Smallest chunk that holds enough objects
+    uint32_t order = 0;
+    while (order < POOL_MAX_ORDER &&
+           ((PAGE_SIZE << order) - first_object(pool)) / pool->object_size < POOL_MIN_OBJECTS) {
+        order++;
+    }
+    pool->chunk_order = order;
+    pool->per_chunk = ((PAGE_SIZE << order) - first_object(pool)) / pool->object_size;
+
+    if (pool->per_chunk == 0) {
+        kfree(pool);
+        return NULL; // Objects bigger than the largest chunk
+    }
+    return pool;
+}
+
+void pool_destroy(pool_t* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pool_chunk_t* chunk = pool->chunks;
+    while (chunk != NULL) {
+        pool_chunk_t* next = chunk->next;
+        free_pages(chunk, chunk->order);
+        chunk = next;
+    }
+    kfree(pool->stack);
+    kfree(pool);
+}
+
+int pool_reserve(pool_t* pool, uint32_t count) {
+    while (pool->top < count) {
+        int result = pool_grow(pool);
+        if (result != MM_SUCCESS) {
+            return result;
+        }
+    }
+    return MM_SUCCESS;
+}
+
+void* pool_get(pool_t* pool) {
+    uint32_t flags = irq_save();
+    if (pool->top == 0) {
+        irq_restore(flags);
+        // Interrupt handlers run with interrupts off and must not reach
+        // kmalloc or alloc_pages, which they may have interrupted
+        if (!(flags & (1 << 9)) || pool_grow(pool) != MM_SUCCESS) {
+            return NULL;
+        }
+        flags = irq_save();
+        if (pool->top == 0) {
+            irq_restore(flags); // An interrupt handler took the new objects
+            return NULL;
+        }
+    }
+    void* obj = pool->stack[--pool->top];
+    irq_restore(flags);
+    return obj;
+}
+
+void pool_put(pool_t* pool, void* obj) {
+    if (obj == NULL) {
+        return;
+    }
+
+    uint32_t flags = irq_save();
+    if (pool->top == pool->capacity) {
+        irq_restore(flags);
+        print_string("pool_put: pool already holds every object it owns\n");
+        return;
+    }
+    pool->stack[pool->top++] = obj;
+    irq_restore(flags);
+}
@@ -0,0 +1,43 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "data/types.h"
+
+#define POOL_CACHE_LINE 64          // Default object alignment
+
+// Runs once per object when its page is carved up, never on pool_get().
+// Objects must be handed back with pool_put() in their constructed state.
+typedef void (*pool_ctor_t)(void* obj);
+
+typedef struct pool_chunk {
+    struct pool_chunk* next;    // Chunks are only returned by pool_destroy()
+    uint32_t order;             // Chunk spans 2^order frames
+} pool_chunk_t;
+
+typedef struct {
+    void** stack;               // Free objects; stack[top - 1] is handed out next
+    uint32_t top;               // Free objects on the stack
+    uint32_t capacity;          // Objects owned by the pool (stack size)
+    uint32_t object_size;       // Size rounded up to the alignment
+    uint32_t align;
+    uint32_t chunk_order;       // Frames per chunk, as an order
+    uint32_t per_chunk;         // Objects carved from each chunk
+    pool_ctor_t ctor;
+    pool_chunk_t* chunks;
+} pool_t;
+
+// align 0 means POOL_CACHE_LINE; align must be a power of two
+pool_t* pool_create(size_t size, size_t align, pool_ctor_t ctor);
+void pool_destroy(pool_t* pool);
+
+// Grow the pool until at least count objects are free, so code running in
+// interrupt context can pool_get() without reaching the frame allocator.
+// Call with interrupts on.
+int pool_reserve(pool_t* pool, uint32_t count);
+
+// Pop / push on the free stack. pool_get() only grows the pool when it is
+// empty and interrupts are on; it returns NULL otherwise or if growing fails.
+void* pool_get(pool_t* pool);
+void pool_put(pool_t* pool, void* obj);
+
+#endif // POOL_H
@@ -0,0 +1,171 @@
+; SSE2 drawing kernels for the console renderer
+; Only used once asm_enable_sse has run on a CPU with FXSR and SSE2
+[BITS 32]
+
+section .text
+global asm_enable_sse
+global asm_fill_span_sse2
+global asm_blit_glyph_sse2
+
+; Allow SSE instructions: clear CR0.EM, set CR0.MP, set CR4.OSFXSR and
+; CR4.OSXMMEXCPT so SIMD faults arrive as #XM rather than #UD
+; void asm_enable_sse(void);
+asm_enable_sse:
+    push ebp
+    mov ebp, esp
+
+    mov eax, cr0
+    and eax, ~0x4       ; CR0.EM
+    or eax, 0x2         ; CR0.MP
+    mov cr0, eax
+
+    mov eax, cr4
+    or eax, 0x600       ; CR4.OSFXSR | CR4.OSXMMEXCPT
+    mov cr4, eax
+
+    pop ebp
+    ret
+
+; Set count pixels to one colour, 16 bytes per store once dst is aligned
+; void asm_fill_span_sse2(u32* dst, u32 count, u32 color);
+asm_fill_span_sse2:
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edi, [ebp+8]    ; Destination (dword aligned)
+    mov ecx, [ebp+12]   ; Pixel count
+    mov eax, [ebp+16]   ; Colour
+    cld
+
+    ; Single pixels up to the first 16-byte boundary
+.head:
+    test ecx, ecx
+    jz .done
+    test edi, 0xF
+    jz .aligned
+    mov [edi], eax
+    add edi, 4
+    dec ecx
+    jmp .head
+
+.aligned:
+    movd xmm0, eax
+    pshufd xmm0, xmm0, 0 ; Colour in all four lanes
+
+    mov edx, ecx
+    shr edx, 4          ; 16 pixels per iteration
+    jz .quads
+.block:
+    movdqa [edi], xmm0
+    movdqa [edi+16], xmm0
+    movdqa [edi+32], xmm0
+    movdqa [edi+48], xmm0
+    add edi, 64
+    dec edx
+    jnz .block
+
+.quads:
+    mov edx, ecx
+    and edx, 0xF
+    shr edx, 2          ; Remaining groups of 4
+    jz .tail
+.quad:
+    movdqa [edi], xmm0
+    add edi, 16
+    dec edx
+    jnz .quad
+
+.tail:
+    and ecx, 3
+    rep stosd
+
+.done:
+    pop edi
+    pop ebp
+    ret
+
+; Paint a 10-pixel wide glyph cell: each row mask picks fg or bg per pixel.
+; A nibble of the mask indexes a 4-lane select mask, so a row is two 16-byte
+; stores for pixels 0-7 and an 8-byte store for pixels 8-9.
+; void asm_blit_glyph_sse2(u32* dst, u32 pitch, const u16* rows, u32 height,
+;                          u32 fg, u32 bg);
+asm_blit_glyph_sse2:
+    push ebp
+    mov ebp, esp
+    push ebx
+    push esi
+    push edi
+
+    mov edi, [ebp+8]    ; Top-left pixel of the cell
+    mov edx, [ebp+12]   ; Bytes per line
+    mov esi, [ebp+16]   ; One mask per row, bit n = pixel n
+    mov ecx, [ebp+20]   ; Rows
+    movd xmm0, [ebp+24]
+    pshufd xmm0, xmm0, 0 ; Foreground in all lanes
+    movd xmm1, [ebp+28]
+    pshufd xmm1, xmm1, 0 ; Background in all lanes
+
+    test ecx, ecx
+    jz .done
+.row:
+    movzx eax, word [esi]
+
+    ; Pixels 0-3
+    mov ebx, eax
+    and ebx, 0xF
+    shl ebx, 4
+    movdqa xmm2, [nibble_masks + ebx]
+    movdqa xmm3, xmm2
+    pand xmm2, xmm0     ; fg where set
+    pandn xmm3, xmm1    ; bg where clear
+    por xmm2, xmm3
+    movdqu [edi], xmm2
+
+    ; Pixels 4-7
+    mov ebx, eax
+    shr ebx, 4
+    and ebx, 0xF
+    shl ebx, 4
+    movdqa xmm2, [nibble_masks + ebx]
+    movdqa xmm3, xmm2
+    pand xmm2, xmm0
+    pandn xmm3, xmm1
+    por xmm2, xmm3
+    movdqu [edi+16], xmm2
+
+    ; Pixels 8-9, the low two lanes
+    shr eax, 8
+    and eax, 0x3
+    shl eax, 4
+    movdqa xmm2, [nibble_masks + eax]
+    movdqa xmm3, xmm2
+    pand xmm2, xmm0
+    pandn xmm3, xmm1
+    por xmm2, xmm3
+    movq [edi+32], xmm2
+
+    add esi, 2
+    add edi, edx
+    dec ecx
+    jnz .row
+
+.done:
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+section .rodata
+; Lane n is all ones when bit n of the index is set
+align 16
+nibble_masks:
+%assign n 0
+%rep 16
+    dd -((n >> 0) & 1), -((n >> 1) & 1), -((n >> 2) & 1), -((n >> 3) & 1)
+%assign n n+1
+%endrep
+
+; Add a .note.GNU-stack section to indicate a non-executable stack
+section .note.GNU-stack noalloc noexec nowrite progbits
@@ -1,7 +1,10 @@
 #include "screen.h"
 #include "data/font_data.h"
 #include "data/types.h"
+#include "data/multiboot.h"
 #include "drivers/timer.h"  // Provides io_wait and other IO functions
+#include "drivers/mm.h"
+#include "drivers/paging.h"
 
 #define NULL ((void*)0)
 
@@ -11,22 +14,39 @@
 #define PIT_FREQUENCY   1193182
 #define SYSTEM_TIMER_HZ 100
 
+// Passes over the blank screen area per bandwidth measurement
+#define FILL_BENCH_PASSES 4
+
 // Screen configuration
 #define PREFERRED_WIDTH  1024
 #define PREFERRED_HEIGHT 768
 #define PREFERRED_BPP    32
 
-// Font dimensions with precise height
+// Font dimensions: the 8x16 font is stretched 1.075x across and 19.25/16
+// down, kept as exact fractions, and each lit bit is two pixels wide
 #define FONT_BASE_WIDTH  8
 #define FONT_BASE_HEIGHT 16
-#define FONT_SCALE      1.075
+#define FONT_SCALE_X_NUM 43
+#define FONT_SCALE_X_DEN 40
+#define FONT_SCALE_Y_NUM 77
+#define FONT_SCALE_Y_DEN 64
 #define FONT_WIDTH      9
-#define FONT_HEIGHT     19.25
+#define FONT_HEIGHT     19
 #define FONT_SPACING    1
+#define FONT_GLYPHS     256
+
+// Character cell in pixels
+#define CELL_WIDTH  (FONT_WIDTH + FONT_SPACING)
+#define CELL_HEIGHT FONT_HEIGHT
+
+// Dirty tracking: one span per text row band of CELL_HEIGHT pixel lines
+#define MAX_DIRTY_BANDS 128
 
-// Screen dimensions in characters
-#define MAX_COLS ((PREFERRED_WIDTH) / (FONT_WIDTH + FONT_SPACING))
-#define MAX_ROWS ((PREFERRED_HEIGHT) / ((u32)FONT_HEIGHT))
+// Text console grid
+#define CONSOLE_CELLS       16384   // Ring of rows incl. scrollback (~160 rows at 102 columns)
+#define CONSOLE_MAX_VISIBLE 12288   // Cells on screen at once (192 x 64)
+#define CONSOLE_COLORS      256     // Distinct colours cells can refer to
+#define CELL_STALE          0x80    // drawn[] attr: pixels no longer show this cell
 
 // Cursor configuration
 #define CURSOR_BLINK_MS 500    // Cursor blink interval in milliseconds
@@ -40,28 +60,61 @@
 #define SVGA_INDEX_PORT     0x3D4
 #define SVGA_DATA_PORT      0x3D5
 
-// Framebuffer addresses
+// Framebuffer addresses, only probed when the boot loader reports none
 #define VGA_FB_BASE     0xA0000
 #define SVGA_FB_BASE    0xE0000000
 #define HIGH_FB_BASE    0xFD000000
 
+// Bochs/QEMU VBE DISPI interface
+#define DISPI_INDEX_PORT      0x1CE
+#define DISPI_DATA_PORT       0x1CF
+#define DISPI_INDEX_ID        0x0
+#define DISPI_INDEX_XRES      0x1
+#define DISPI_INDEX_YRES      0x2
+#define DISPI_INDEX_BPP       0x3
+#define DISPI_INDEX_ENABLE    0x4
+#define DISPI_INDEX_VIRT_WIDTH  0x6
+#define DISPI_INDEX_VIRT_HEIGHT 0x7
+#define DISPI_INDEX_Y_OFFSET  0x9
+#define DISPI_ID_MIN          0xB0C1    // First version with a virtual display and offsets
+#define DISPI_ID_MAX          0xB0CF
+#define DISPI_ENABLED         0x01
+#define DISPI_LFB_ENABLED     0x40
+
+// Multiboot framebuffer_type for direct RGB colour, and the channel layout
+// of the 0x00RRGGBB pixels the renderer writes
+#define MULTIBOOT_FB_TYPE_RGB 1
+#define FB_RED_POSITION       16
+#define FB_GREEN_POSITION     8
+#define FB_BLUE_POSITION      0
+#define FB_CHANNEL_BITS       8
+
 // Update system_timer variables to include a forced blink mechanism
 static volatile u32 system_ticks = 0;
 static volatile u32 ms_counter = 0;
 static volatile boolean force_cursor_active = TRUE;
 
+// Assembly kernels from screen.asm
+void asm_enable_sse(void);
+void asm_fill_span_sse2(u32* dst, u32 count, u32 color);
+void asm_blit_glyph_sse2(u32* dst, u32 pitch, const u16* rows, u32 height, u32 fg, u32 bg);
+
 // Cursor blinking variables
 static u32 last_blink_tick = 0;
 static u32 blink_count = 0;
 
 typedef struct {
-    u32*    framebuffer;
+    u32*    framebuffer;        // Where the kernel reaches it (physical until paging)
+    u32     fb_phys;            // Physical address
+    u32*    shadow;             // RAM copy everything is drawn into, NULL until enabled
     u32     width;
     u32     height;
     u32     pitch;
     u32     bpp;
     u32     fg_color;
     u32     bg_color;
+    u32     cols;               // Text grid size in cells
+    u32     rows;
     u32     cursor_x;
     u32     cursor_y;
     boolean initialized;
@@ -70,12 +123,16 @@ typedef struct {
 
 static screen_t screen = {
     .framebuffer = (u32*)HIGH_FB_BASE,
+    .fb_phys = HIGH_FB_BASE,
+    .shadow = NULL,
     .width = PREFERRED_WIDTH,
     .height = PREFERRED_HEIGHT,
     .pitch = PREFERRED_WIDTH * 4,
     .bpp = PREFERRED_BPP,
     .fg_color = 0xFFFFFFFF,
     .bg_color = 0x00000000,
+    .cols = 0,
+    .rows = 0,
     .cursor_x = 0,
     .cursor_y = 0,
     .initialized = FALSE,
@@ -100,36 +157,552 @@ static u32 get_system_time_ms(void) {
     return timer_get_ticks() * 10;
 }
 
-static void draw_pixel(u32 x, u32 y, u32 color) {
-    if (!screen.initialized || x >= screen.width || y >= screen.height) {
+/*
+ * Text console.
+ *
+ * The console is a grid of cells (character, colours, attributes) kept in a
+ * ring of rows; the rows above the screen are scrollback. Scrolling moves
+ * ring_top on by one and blanks a single row. drawn[] records what the
+ * pixels of each screen cell currently show, and rendering only repaints
+ * cells of dirty rows that differ from it, so a scroll redraws the
+ * characters that actually moved and blank cells cost a compare.
+ *
+ * Colours are stored as indexes into a small palette of the colours
+ * set_colors() has seen, which keeps a cell at four bytes.
+ */
+typedef struct {
+    u8 ch;
+    u8 fg;                      // Palette indexes
+    u8 bg;
+    u8 attr;
+} cell_t;
+
+static cell_t cells[CONSOLE_CELLS];         // ring_rows rows of screen.cols cells
+static cell_t drawn[CONSOLE_MAX_VISIBLE];   // What each screen cell shows now
+static u8 row_dirty[MAX_DIRTY_BANDS];       // Screen rows to compare against drawn[]
+static u32 ring_rows = 0;
+static u32 ring_top = 0;                    // Ring row of screen row 0 when following output
+static u32 history_rows = 0;                // Rows above ring_top kept for scrollback
+static u32 view_offset = 0;                 // Rows scrolled back, 0 while following output
+
+static u32 palette[CONSOLE_COLORS];
+static u32 palette_count = 0;
+static u8 fg_index = 0;
+static u8 bg_index = 0;
+
+// Each glyph scaled to the cell: one mask per pixel row, bit n = column n
+static u16 glyph_rows[FONT_GLYPHS][CELL_HEIGHT];
+
+// Where the cursor bar was last drawn
+static boolean cursor_shown = FALSE;
+static u32 cursor_shown_x = 0;
+static u32 cursor_shown_y = 0;
+
+/*
+ * Back buffer.
+ *
+ * Once screen_enable_backbuffer() has run, drawing goes to a shadow copy in
+ * RAM and each change marks the pixel span it touched in its text row band.
+ * present() copies the dirty spans to the framebuffer with memcpy, so VRAM
+ * is only ever written in bulk and never read. Output is batched: nested
+ * print calls raise batch_depth and only the outermost one presents, and
+ * the timer tick picks up anything still pending.
+ */
+static u32 dirty_x0[MAX_DIRTY_BANDS];   // Dirty span of each band, [x0, x1)
+static u32 dirty_x1[MAX_DIRTY_BANDS];   // x1 == 0 while the band is clean
+static volatile u32 batch_depth = 0;
+
+/*
+ * SIMD drawing.
+ *
+ * Fills and glyphs go through the SSE2 kernels in screen.asm when the CPU
+ * has them. Interrupt entry does not save XMM state, which is safe because
+ * nothing else in the kernel uses SSE and drawing only happens with
+ * batch_depth raised, so a timer tick never draws over a kernel in progress.
+ */
+static boolean simd_enabled = FALSE;
+
+/*
+ * Hardware scrolling.
+ *
+ * On Bochs/QEMU std-vga the displayed picture is a window onto a taller
+ * virtual framebuffer, and its top line is a DISPI register. The console
+ * draws straight into VRAM there (nothing reads pixels back, so no shadow
+ * is needed) at pan_row text rows down. A scroll moves pan_row on, shifts
+ * drawn[] to match what the moved window now shows, renders the rows that
+ * came into view below the old window and only then writes the offset, so
+ * the new picture appears in one step. At the bottom of VRAM the window
+ * goes back to the top with a full render into the then hidden area.
+ */
+static boolean dispi_active = FALSE;
+static u32 dispi_lines = 0;             // Virtual framebuffer height in pixel lines
+static u32 dispi_window = 0;            // Lines the display shows from pan_row down (YRES)
+static u32 pan_row = 0;                 // VRAM text row at the top of the screen
+static u32 pan_pending = 0;             // Rows scrolled since the last render
+static boolean flip_pending = FALSE;    // pan_row changed, offset not yet written
+
+static inline void outw(u16 port, u16 value) {
+    __asm__ volatile("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline u16 inw(u16 port) {
+    u16 value;
+    __asm__ volatile("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static u16 dispi_read(u16 index) {
+    outw(DISPI_INDEX_PORT, index);
+    return inw(DISPI_DATA_PORT);
+}
+
+static void dispi_write(u16 index, u16 value) {
+    outw(DISPI_INDEX_PORT, index);
+    outw(DISPI_DATA_PORT, value);
+}
+
+// Bytes from one line to the next in whatever is being drawn into
+static inline u32 draw_pitch(void) {
+    return screen.shadow ? screen.width * sizeof(u32) : screen.pitch;
+}
+
+// First pixel of line y in whatever is being drawn into
+static inline u32* draw_row(u32 y) {
+    return screen.shadow ? screen.shadow + y * screen.width
+                         : (u32*)((u8*)screen.framebuffer + (pan_row * CELL_HEIGHT + y) * screen.pitch);
+}
+
+static void mark_dirty(u32 x, u32 y, u32 w, u32 h) {
+    if (!screen.shadow || x >= screen.width || y >= screen.height) {
+        return;
+    }
+    
+    u32 x1 = (x + w < screen.width) ? x + w : screen.width;
+    u32 y1 = (y + h < screen.height) ? y + h : screen.height;
+    for (u32 band = y / CELL_HEIGHT; band <= (y1 - 1) / CELL_HEIGHT; band++) {
+        if (dirty_x1[band] == 0) {
+            dirty_x0[band] = x;
+            dirty_x1[band] = x1;
+        } else {
+            if (x < dirty_x0[band]) dirty_x0[band] = x;
+            if (x1 > dirty_x1[band]) dirty_x1[band] = x1;
+        }
+    }
+}
+
+// Copy every dirty span to the framebuffer
+static void flush_dirty(void) {
+    batch_depth++; // A timer tick landing in here only marks, never flushes
+    
+    u32 bands = (screen.height + CELL_HEIGHT - 1) / CELL_HEIGHT;
+    u32 row_bytes = screen.width * sizeof(u32);
+    for (u32 band = 0; band < bands; band++) {
+        if (dirty_x1[band] == 0) {
+            continue;
+        }
+        u32 x0 = dirty_x0[band];
+        u32 x1 = dirty_x1[band];
+        dirty_x1[band] = 0;
+        
+        u32 y0 = band * CELL_HEIGHT;
+        u32 y1 = y0 + CELL_HEIGHT;
+        
+        // Whole-width bands back to back are one contiguous copy when the
+        // framebuffer has no padding at the end of its lines
+        if (x0 == 0 && x1 == screen.width && screen.pitch == row_bytes) {
+            while (band + 1 < bands && dirty_x0[band + 1] == 0 &&
+                   dirty_x1[band + 1] == screen.width) {
+                dirty_x1[++band] = 0;
+                y1 += CELL_HEIGHT;
+            }
+            if (y1 > screen.height) y1 = screen.height;
+            memcpy((u8*)screen.framebuffer + y0 * screen.pitch, screen.shadow + y0 * screen.width,
+                   (y1 - y0) * row_bytes);
+            continue;
+        }
+        
+        if (y1 > screen.height) y1 = screen.height;
+        for (u32 y = y0; y < y1; y++) {
+            memcpy((u8*)screen.framebuffer + y * screen.pitch + x0 * sizeof(u32),
+                   screen.shadow + y * screen.width + x0, (x1 - x0) * sizeof(u32));
+        }
+    }
+    
+    batch_depth--;
+}
+
+static void console_render(void);
+
+// Put pending changes on screen unless a batch is still open
+static void present(void) {
+    if (!screen.initialized || batch_depth != 0) {
+        return;
+    }
+    
+    batch_depth++;
+    console_render();
+    batch_depth--;
+    if (screen.shadow) {
+        flush_dirty();
+    }
+}
+
+// Set a rectangle to one colour (clipped to the screen)
+static void fill_rect(u32 x, u32 y, u32 w, u32 h, u32 color) {
+    if (x >= screen.width || y >= screen.height) {
         return;
     }
+    if (w > screen.width - x) w = screen.width - x;
+    if (h > screen.height - y) h = screen.height - y;
     
-    u32 offset = y * screen.width + x;
-    if (offset < (screen.width * screen.height)) {
-        screen.framebuffer[offset] = color;
+    for (u32 row = y; row < y + h; row++) {
+        u32* line = draw_row(row) + x;
+        if (simd_enabled) {
+            asm_fill_span_sse2(line, w, color);
+            continue;
+        }
+        for (u32 i = 0; i < w; i++) {
+            line[i] = color;
+        }
     }
+    mark_dirty(x, y, w, h);
 }
 
 // Function prototypes
-static void draw_cursor(void);
-static void draw_char_at(char c, u32 x, u32 y);
-static void scroll_screen(void);
 static boolean try_framebuffer_address(u32* addr);
 
-static void draw_cursor(void) {
-    if (!screen.initialized) return;
+// Scale every glyph of font_8x16 to the cell once, so drawing a character
+// is a store per pixel with no arithmetic
+static void build_glyph_cache(void) {
+    for (u32 c = 0; c < FONT_GLYPHS; c++) {
+        for (u32 dy = 0; dy < CELL_HEIGHT; dy++) {
+            glyph_rows[c][dy] = 0;
+        }
+        
+        for (u32 dy = 0; dy < FONT_BASE_HEIGHT; dy++) {
+            u8 bits = font_8x16[c][dy];
+            u16 mask = 0;
+            for (u32 dx = 0; dx < FONT_BASE_WIDTH; dx++) {
+                if (bits & (0x80 >> dx)) {
+                    u32 px = dx * FONT_SCALE_X_NUM / FONT_SCALE_X_DEN;
+                    mask |= 3 << px;
+                }
+            }
+            
+            // Source row dy covers output rows [dy, dy + 1) * 19.25 / 16
+            u32 py_start = dy * FONT_SCALE_Y_NUM / FONT_SCALE_Y_DEN;
+            u32 py_end = (dy + 1) * FONT_SCALE_Y_NUM / FONT_SCALE_Y_DEN;
+            for (u32 py = py_start; py < py_end && py < CELL_HEIGHT; py++) {
+                glyph_rows[c][py] |= mask;
+            }
+        }
+    }
+}
+
+/* Console grid */
+// Ring row for an index that may be several ring lengths past the end
+// (view_row() adds ring_top, ring_rows and y together)
+static inline u32 ring_wrap(u32 row) {
+    return row % ring_rows;
+}
+
+// Cells of screen row y as output sees it
+static inline cell_t* live_row(u32 y) {
+    return &cells[ring_wrap(ring_top + y) * screen.cols];
+}
+
+// Cells of screen row y as currently viewed (scrollback moves this up)
+static inline cell_t* view_row(u32 y) {
+    return &cells[ring_wrap(ring_top + ring_rows - view_offset + y) * screen.cols];
+}
+
+static inline cell_t blank_cell(void) {
+    cell_t cell = { ' ', fg_index, bg_index, 0 };
+    return cell;
+}
+
+static inline boolean same_cell(cell_t a, cell_t b) {
+    return a.ch == b.ch && a.fg == b.fg && a.bg == b.bg && a.attr == b.attr;
+}
+
+// Palette slot for a colour, adding it if new. A full palette recycles its
+// last slot, which recolours cells that still use it.
+static u8 palette_index(u32 color) {
+    for (u32 i = 0; i < palette_count; i++) {
+        if (palette[i] == color) {
+            return (u8)i;
+        }
+    }
+    if (palette_count < CONSOLE_COLORS) {
+        palette_count++;
+    }
+    palette[palette_count - 1] = color;
+    return (u8)(palette_count - 1);
+}
+
+static void mark_rows_dirty(void) {
+    for (u32 y = 0; y < screen.rows; y++) {
+        row_dirty[y] = 1;
+    }
+}
+
+// Output below the screen needs no mark: console_commit_scroll() marks
+// every row when it brings it into view
+static inline void mark_row_dirty(u32 y) {
+    if (y < screen.rows) {
+        row_dirty[y] = 1;
+    }
+}
+
+// Forget what the pixels show, so the next render repaints every cell
+static void invalidate_drawn(void) {
+    for (u32 i = 0; i < screen.cols * screen.rows; i++) {
+        drawn[i].attr = CELL_STALE;
+    }
+    cursor_shown = FALSE;
+    mark_rows_dirty();
+}
+
+// Size the grid to the screen and empty it, scrollback included
+static void console_reset(void) {
+    screen.cols = screen.width / CELL_WIDTH;
+    screen.rows = screen.height / CELL_HEIGHT;
+    if (screen.rows > MAX_DIRTY_BANDS) {
+        screen.rows = MAX_DIRTY_BANDS;
+    }
+    if (screen.cols * screen.rows > CONSOLE_MAX_VISIBLE) {
+        screen.rows = CONSOLE_MAX_VISIBLE / screen.cols;
+    }
+    
+    ring_rows = CONSOLE_CELLS / screen.cols;
+    ring_top = 0;
+    history_rows = 0;
+    view_offset = 0;
+    
+    cell_t blank = blank_cell();
+    for (u32 i = 0; i < ring_rows * screen.cols; i++) {
+        cells[i] = blank;
+    }
+    screen.cursor_x = 0;
+    screen.cursor_y = 0;
+    invalidate_drawn();
+}
+
+// Blank a row below the screen before output moves onto it
+static void console_open_row(u32 y) {
+    cell_t* row = live_row(y);
+    cell_t blank = blank_cell();
+    for (u32 x = 0; x < screen.cols; x++) {
+        row[x] = blank;
+    }
+}
+
+// Scroll by however many rows output ran past the bottom, all at once: the
+// ring top moves on and the rows it passed become scrollback
+static void console_commit_scroll(void) {
+    if (screen.cursor_y < screen.rows) {
+        return;
+    }
+    
+    // console_put() commits before the cursor can lap the ring, so lines
+    // is always less than ring_rows
+    u32 lines = screen.cursor_y - (screen.rows - 1);
+    ring_top = ring_wrap(ring_top + lines);
+    history_rows += lines;
+    if (history_rows > ring_rows - screen.rows) {
+        history_rows = ring_rows - screen.rows;
+    }
+    screen.cursor_y -= lines;
+    mark_rows_dirty();
+    
+    if (dispi_active) {
+        pan_pending += lines;
+    }
+}
+
+// Apply one character to the grid. Output may run below the screen; the
+// rows it leaves behind are only scrolled out by console_commit_scroll().
+static void console_put(char c) {
+    // New output brings the view back to the bottom
+    if (view_offset != 0) {
+        view_offset = 0;
+        mark_rows_dirty();
+    }
+    
+    cell_t* row = live_row(screen.cursor_y);
+    switch (c) {
+        case '\n':
+            screen.cursor_x = 0;
+            screen.cursor_y++;
+            break;
+        case '\r':
+            screen.cursor_x = 0;
+            break;
+        case '\t':
+            screen.cursor_x = (screen.cursor_x + 8) & ~7;
+            break;
+        case '\b':
+            if (screen.cursor_x > 0) {
+                screen.cursor_x--;
+                row[screen.cursor_x] = blank_cell();
+                mark_row_dirty(screen.cursor_y);
+            }
+            break;
+        default:
+            row[screen.cursor_x].ch = (u8)c;
+            row[screen.cursor_x].fg = fg_index;
+            row[screen.cursor_x].bg = bg_index;
+            row[screen.cursor_x].attr = 0;
+            mark_row_dirty(screen.cursor_y);
+            screen.cursor_x++;
+            break;
+    }
 
-    u32 cursor_x = screen.cursor_x * (FONT_WIDTH + FONT_SPACING);
-    u32 cursor_y = (screen.cursor_y * (u32)FONT_HEIGHT) + ((u32)FONT_HEIGHT - CURSOR_THICKNESS);
+    // Update cursor position
+    if (screen.cursor_x >= screen.cols) {
+        screen.cursor_x = 0;
+        screen.cursor_y++;
+    }
+    if (screen.cursor_y >= screen.rows) {
+        // Don't run into the rows still on screen from the other side
+        if (screen.cursor_y >= ring_rows - 1) {
+            console_commit_scroll();
+        }
+        console_open_row(screen.cursor_y);
+    }
+}
 
-    for (u32 i = 0; i < CURSOR_THICKNESS; i++) {
-        for (u32 j = 0; j < FONT_WIDTH; j++) {
-            // Draw cursor with current visibility state
-            draw_pixel(cursor_x + j, cursor_y + i,
-                      screen.cursor_visible ? screen.fg_color : screen.bg_color);
+/* Rendering */
+// Paint one cell, glyph and background together. The grid never extends
+// past the screen, so there is nothing to clip.
+static void render_cell(u32 x, u32 y, cell_t cell) {
+    const u16* rows = glyph_rows[cell.ch];
+    u32 fg = palette[cell.fg];
+    u32 bg = palette[cell.bg];
+    u32 px = x * CELL_WIDTH;
+    u32 py = y * CELL_HEIGHT;
+    
+    // The SIMD blit writes exactly CELL_WIDTH (10) pixels per row
+    if (simd_enabled) {
+        asm_blit_glyph_sse2(draw_row(py) + px, draw_pitch(), rows, CELL_HEIGHT, fg, bg);
+        mark_dirty(px, py, CELL_WIDTH, CELL_HEIGHT);
+        return;
+    }
+    
+    for (u32 dy = 0; dy < CELL_HEIGHT; dy++) {
+        u32* line = draw_row(py + dy) + px;
+        u32 mask = rows[dy];
+        for (u32 dx = 0; dx < CELL_WIDTH; dx++) {
+            line[dx] = ((mask >> dx) & 1) ? fg : bg;
         }
     }
+    mark_dirty(px, py, CELL_WIDTH, CELL_HEIGHT);
+}
+
+// Whether a window starting at text row row lies inside VRAM. Lines are
+// what matters: VRAM is rarely a whole number of text rows.
+static inline boolean dispi_window_fits(u32 row) {
+    return row * CELL_HEIGHT + dispi_window <= dispi_lines;
+}
+
+// Whether a window starting at text row row shares no line with the one
+// on display at pan_row
+static inline boolean dispi_window_hidden(u32 row) {
+    u32 start = row * CELL_HEIGHT;
+    u32 shown = pan_row * CELL_HEIGHT;
+    return start >= shown + dispi_window || start + dispi_window <= shown;
+}
+
+// Move the hardware window down by lines text rows. Drawing follows at
+// once; the offset register is written by console_render() when it is done.
+static void dispi_pan(u32 lines) {
+    u32 target = pan_row + lines;
+
+    if (lines < screen.rows && dispi_window_fits(target)) {
+        // Cells keep their pixels, now lines rows further up the screen
+        u32 kept = (screen.rows - lines) * screen.cols;
+        memmove(drawn, &drawn[lines * screen.cols], kept * sizeof(cell_t));
+        for (u32 i = kept; i < screen.rows * screen.cols; i++) {
+            drawn[i].attr = CELL_STALE;
+        }
+        if (cursor_shown && cursor_shown_y >= lines) {
+            cursor_shown_y -= lines;
+        } else {
+            cursor_shown = FALSE;
+        }
+        pan_row = target;
+    } else {
+        // A whole new picture: draw it where nothing on display is
+        // overwritten, so it only appears when the offset moves
+        u32 after = (pan_row * CELL_HEIGHT + dispi_window + CELL_HEIGHT - 1) / CELL_HEIGHT;
+        if (dispi_window_fits(target) && dispi_window_hidden(target)) {
+            pan_row = target;
+        } else if (dispi_window_hidden(0)) {
+            pan_row = 0;
+        } else if (dispi_window_fits(after)) {
+            pan_row = after;
+        } else {
+            pan_row = 0; // dispi_init() leaves room for one of the above
+        }
+        invalidate_drawn();
+    }
+    
+    // The lines below the last text row come from VRAM the window just took in
+    u32 grid_bottom = screen.rows * CELL_HEIGHT;
+    fill_rect(0, grid_bottom, screen.width, screen.height - grid_bottom, screen.bg_color);
+    flip_pending = TRUE;
+}
+
+// Repaint changed cells of dirty rows, then the cursor bar on top
+static void console_render(void) {
+    if (pan_pending) {
+        dispi_pan(pan_pending);
+        pan_pending = 0;
+    }
+    
+    boolean want_cursor = screen.cursor_visible && view_offset == 0;
+    
+    // A bar that moved or went away leaves its cell to be repainted
+    if (cursor_shown && (!want_cursor || cursor_shown_x != screen.cursor_x ||
+                         cursor_shown_y != screen.cursor_y)) {
+        drawn[cursor_shown_y * screen.cols + cursor_shown_x].attr |= CELL_STALE;
+        row_dirty[cursor_shown_y] = 1;
+        cursor_shown = FALSE;
+    }
+    
+    for (u32 y = 0; y < screen.rows; y++) {
+        if (!row_dirty[y]) {
+            continue;
+        }
+        row_dirty[y] = 0;
+        
+        const cell_t* src = view_row(y);
+        cell_t* dst = &drawn[y * screen.cols];
+        for (u32 x = 0; x < screen.cols; x++) {
+            if (same_cell(src[x], dst[x])) {
+                continue;
+            }
+            render_cell(x, y, src[x]);
+            dst[x] = src[x];
+            if (cursor_shown && x == cursor_shown_x && y == cursor_shown_y) {
+                cursor_shown = FALSE; // Painted over
+            }
+        }
+    }
+    
+    if (want_cursor && !cursor_shown) {
+        fill_rect(screen.cursor_x * CELL_WIDTH,
+                  screen.cursor_y * CELL_HEIGHT + CELL_HEIGHT - CURSOR_THICKNESS,
+                  FONT_WIDTH, CURSOR_THICKNESS, screen.fg_color);
+        cursor_shown = TRUE;
+        cursor_shown_x = screen.cursor_x;
+        cursor_shown_y = screen.cursor_y;
+    }
+    
+    if (flip_pending) {
+        dispi_write(DISPI_INDEX_Y_OFFSET, pan_row * CELL_HEIGHT);
+        flip_pending = FALSE;
+    }
 }
 
 static boolean try_framebuffer_address(u32* addr) {
@@ -149,17 +722,160 @@ static boolean try_framebuffer_address(u32* addr) {
     return TRUE;
 }
 
-i32 init_screen(void) {
+// Whether a framebuffer can be drawn to before paging_init(). The boot
+// directory identity maps everything but the kernel window; after paging
+// the framebuffer moves to a window of its own, clear of the heap, the
+// demand-zero window and kmap wherever it lies.
+static boolean fb_reachable(u32 phys, u32 size) {
+    return phys + size <= KERNEL_VIRTUAL_BASE || phys >= KERNEL_VIRTUAL_BASE + BOOT_WINDOW_SIZE;
+}
+
+// Take the mode the boot loader set from the multiboot info. Only 32 bpp
+// RGB laid out as 0x00RRGGBB is drawable.
+static i32 use_multiboot_framebuffer(const multiboot_info_t* mbi) {
+    if (mbi->framebuffer_type != MULTIBOOT_FB_TYPE_RGB || mbi->framebuffer_bpp != 32 ||
+        (mbi->framebuffer_addr >> 32) != 0 || mbi->framebuffer_addr == 0) {
+        return SCREEN_ERROR;
+    }
+    
+    // color_info is position/size for red, green and blue
+    const u8* channels = mbi->color_info;
+    if (channels[0] != FB_RED_POSITION || channels[1] != FB_CHANNEL_BITS ||
+        channels[2] != FB_GREEN_POSITION || channels[3] != FB_CHANNEL_BITS ||
+        channels[4] != FB_BLUE_POSITION || channels[5] != FB_CHANNEL_BITS) {
+        return SCREEN_ERROR;
+    }
+    
+    if (mbi->framebuffer_width < CELL_WIDTH || mbi->framebuffer_height < CELL_HEIGHT ||
+        mbi->framebuffer_pitch < mbi->framebuffer_width * sizeof(u32)) {
+        return SCREEN_ERROR;
+    }
+    u32 size = mbi->framebuffer_pitch * mbi->framebuffer_height;
+    if (mbi->framebuffer_addr + size > 0x100000000ULL ||
+        !fb_reachable((u32)mbi->framebuffer_addr, size)) {
+        return SCREEN_ERROR;
+    }
+    
+    screen.fb_phys = (u32)mbi->framebuffer_addr;
+    screen.framebuffer = (u32*)screen.fb_phys;
+    screen.width = mbi->framebuffer_width;
+    screen.height = mbi->framebuffer_height;
+    screen.pitch = mbi->framebuffer_pitch;
+    screen.bpp = mbi->framebuffer_bpp;
+    
+    // Dirty tracking has a fixed number of row bands; lines past them stay unused
+    if (screen.height > MAX_DIRTY_BANDS * CELL_HEIGHT) {
+        screen.height = MAX_DIRTY_BANDS * CELL_HEIGHT;
+    }
+    return SCREEN_SUCCESS;
+}
+
+// Program a 32 bpp mode with the linear framebuffer on through DISPI, for
+// when the boot loader left none we can draw in
+static i32 dispi_set_mode(u32 width, u32 height) {
+    u16 id = dispi_read(DISPI_INDEX_ID);
+    if (id < DISPI_ID_MIN || id > DISPI_ID_MAX) {
+        return SCREEN_ERROR;
+    }
+    
+    dispi_write(DISPI_INDEX_ENABLE, 0);
+    dispi_write(DISPI_INDEX_XRES, width);
+    dispi_write(DISPI_INDEX_YRES, height);
+    dispi_write(DISPI_INDEX_BPP, 32);
+    dispi_write(DISPI_INDEX_ENABLE, DISPI_ENABLED | DISPI_LFB_ENABLED);
+    
+    // The adapter may refuse a mode its memory cannot hold
+    if (dispi_read(DISPI_INDEX_XRES) != width || dispi_read(DISPI_INDEX_YRES) != height ||
+        dispi_read(DISPI_INDEX_BPP) != 32) {
+        return SCREEN_ERROR;
+    }
+    
+    screen.width = width;
+    screen.height = height;
+    screen.pitch = dispi_read(DISPI_INDEX_VIRT_WIDTH) * sizeof(u32);
+    screen.bpp = 32;
+    return SCREEN_SUCCESS;
+}
+
+// Use DISPI panning if the framebuffer is a Bochs/QEMU one in the mode we
+// draw in and its VRAM holds at least two screens of text rows
+static void dispi_init(void) {
+    u16 id = dispi_read(DISPI_INDEX_ID);
+    if (id < DISPI_ID_MIN || id > DISPI_ID_MAX) {
+        return;
+    }
+    if (!(dispi_read(DISPI_INDEX_ENABLE) & DISPI_ENABLED) ||
+        dispi_read(DISPI_INDEX_XRES) != screen.width ||
+        dispi_read(DISPI_INDEX_YRES) < screen.height ||
+        dispi_read(DISPI_INDEX_BPP) != 32 ||
+        dispi_read(DISPI_INDEX_VIRT_WIDTH) * sizeof(u32) != screen.pitch) {
+        return;
+    }
+    
+    // The virtual height is all of VRAM at this line length. A full redraw
+    // goes above the window on display if that starts a window or more
+    // down, else below it, which ends before 3 windows plus a text row.
+    dispi_lines = dispi_read(DISPI_INDEX_VIRT_HEIGHT);
+    dispi_window = dispi_read(DISPI_INDEX_YRES);
+    if (dispi_lines < 3 * dispi_window + CELL_HEIGHT) {
+        return;
+    }
+    
+    pan_row = 0;
+    dispi_write(DISPI_INDEX_Y_OFFSET, 0);
+    dispi_active = TRUE;
+}
+
+i32 init_screen(u32 mboot_info_addr) {
+    const multiboot_info_t* mbi = (const multiboot_info_t*)mboot_info_addr;
+    
     init_system_timer();
     
-    if (try_framebuffer_address((u32*)HIGH_FB_BASE)) {
+    boolean have_info = mbi != NULL && (mbi->flags & MULTIBOOT_INFO_FRAMEBUFFER);
+    if (have_info && use_multiboot_framebuffer(mbi) == SCREEN_SUCCESS) {
+        // The boot loader's mode as it is
+    } else if (dispi_set_mode(PREFERRED_WIDTH, PREFERRED_HEIGHT) == SCREEN_SUCCESS) {
+        // A mode we cannot draw in, or none reported: set our own on a
+        // Bochs/QEMU adapter. Its LFB is the one the loader reported, if
+        // reachable, else one of the usual addresses.
+        u32 size = screen.pitch * screen.height;
+        if (have_info && (mbi->framebuffer_addr >> 32) == 0 &&
+            fb_reachable((u32)mbi->framebuffer_addr, size)) {
+            screen.fb_phys = (u32)mbi->framebuffer_addr;
+        } else if (try_framebuffer_address((u32*)HIGH_FB_BASE)) {
+            screen.fb_phys = HIGH_FB_BASE;
+        } else if (try_framebuffer_address((u32*)SVGA_FB_BASE)) {
+            screen.fb_phys = SVGA_FB_BASE;
+        } else {
+            return SCREEN_ERROR;
+        }
+        screen.framebuffer = (u32*)screen.fb_phys;
+    } else if (have_info) {
+        return SCREEN_ERROR;
+    } else if (try_framebuffer_address((u32*)HIGH_FB_BASE)) {
+        // Loaders without framebuffer info: look for the usual QEMU/Bochs
+        // addresses and assume the mode we asked for
+        screen.fb_phys = HIGH_FB_BASE;
         screen.framebuffer = (u32*)HIGH_FB_BASE;
     } else if (try_framebuffer_address((u32*)SVGA_FB_BASE)) {
+        screen.fb_phys = SVGA_FB_BASE;
         screen.framebuffer = (u32*)SVGA_FB_BASE;
     } else {
         return SCREEN_ERROR;
     }
     
+    if ((cpu_features & (CPU_FEATURE_FXSR | CPU_FEATURE_SSE2)) ==
+        (CPU_FEATURE_FXSR | CPU_FEATURE_SSE2)) {
+        asm_enable_sse();
+        simd_enabled = TRUE;
+    }
+    
+    build_glyph_cache();
+    fg_index = palette_index(screen.fg_color);
+    bg_index = palette_index(screen.bg_color);
+    console_reset();
+    dispi_init();
+    
     screen.initialized = TRUE;
     clear_screen();
     
@@ -170,160 +886,185 @@ i32 init_screen(void) {
     return SCREEN_SUCCESS;
 }
 
-static void draw_char_at(char c, u32 x, u32 y) {
-    if (!screen.initialized) return;
-    
-    u8 uc = (u8)c;
-    const u8* glyph = font_8x16[uc];
+// Switch drawing to a RAM back buffer. Needs paging and the page fault
+// handler, since the buffer is a pinned demand-zero reservation. Hardware
+// scrolling presents through the DISPI offset instead and needs none.
+i32 screen_enable_backbuffer(void) {
+    if (!screen.initialized || screen.shadow) {
+        return screen.shadow ? SCREEN_SUCCESS : SCREEN_ERROR;
+    }
+    if (dispi_active) {
+        return SCREEN_SUCCESS;
+    }
     
-    u32 base_x = x * (FONT_WIDTH + FONT_SPACING);
-    u32 base_y = y * (u32)FONT_HEIGHT;
+    u32 row_bytes = screen.width * sizeof(u32);
+    u32* shadow = (u32*)vm_reserve(row_bytes * screen.height, PAGE_WRITE | VM_PINNED);
+    if (shadow == NULL) {
+        return SCREEN_ERROR;
+    }
     
-    // Direct pixel rendering with precise height scaling
-    for (u32 dy = 0; dy < FONT_BASE_HEIGHT; dy++) {
-        u8 row = glyph[dy];
-        float y_stretch = FONT_HEIGHT / FONT_BASE_HEIGHT;
-        u32 py_start = base_y + (u32)(dy * y_stretch);
-        u32 py_end = base_y + (u32)((dy + 1) * y_stretch);
-        
-        for (u32 dx = 0; dx < FONT_BASE_WIDTH; dx++) {
-            if (row & (0x80 >> dx)) {
-                u32 px = base_x + (u32)(dx * FONT_SCALE);
-                
-                // Draw vertically stretched pixel
-                for (u32 py = py_start; py < py_end; py++) {
-                    draw_pixel(px, py, screen.fg_color);
-                    if (FONT_SCALE > 1.0) {
-                        draw_pixel(px + 1, py, screen.fg_color);
-                    }
-                }
-            }
-        }
+    // Rebuild the picture from the grid rather than reading it back
+    batch_depth++;
+    for (u32 band = 0; band < MAX_DIRTY_BANDS; band++) {
+        dirty_x1[band] = 0;
     }
+    screen.shadow = shadow;
+    fill_rect(0, 0, screen.width, screen.height, screen.bg_color);
+    invalidate_drawn();
+    batch_depth--;
+    present();
+    
+    return SCREEN_SUCCESS;
 }
 
-void print_char(char c) {
-    if (!screen.initialized) return;
-
-    // Store cursor visibility temporarily but don't reset blinking
-    boolean was_visible = screen.cursor_visible;
-    screen.cursor_visible = FALSE;
-    draw_cursor();
-
-    switch (c) {
-        case '\n':
-            screen.cursor_x = 0;
-            screen.cursor_y++;
-            break;
-        case '\r':
-            screen.cursor_x = 0;
-            break;
-        case '\t':
-            screen.cursor_x = (screen.cursor_x + 8) & ~7;
-            break;
-        case '\b':
-            if (screen.cursor_x > 0) {
-                screen.cursor_x--;
-                u32 base_x = screen.cursor_x * (FONT_WIDTH + FONT_SPACING);
-                u32 base_y = screen.cursor_y * (u32)FONT_HEIGHT;
-                for (u32 y = 0; y < (u32)FONT_HEIGHT; y++) {
-                    for (u32 x = 0; x < FONT_WIDTH + FONT_SPACING; x++) {
-                        draw_pixel(base_x + x, base_y + y, screen.bg_color);
-                    }
-                }
-            }
-            break;
-        default:
-            draw_char_at(c, screen.cursor_x, screen.cursor_y);
-            screen.cursor_x++;
-            break;
-    }
-
-    // Update cursor position
-    if (screen.cursor_x >= MAX_COLS) {
-        screen.cursor_x = 0;
-        screen.cursor_y++;
-    }
-    if (screen.cursor_y >= MAX_ROWS) {
-        scroll_screen();
+// Write len characters in one pass: the cursor is drawn once at the end and
+// any scrolling happens as a single move
+void console_write(const char* str, size_t len) {
+    if (!screen.initialized || !str) return;
+    
+    batch_depth++;
+    for (size_t i = 0; i < len; i++) {
+        console_put(str[i]);
     }
+    console_commit_scroll();
+    batch_depth--;
+    present();
+}
 
-    // Restore cursor visibility without disrupting blink cycle
-    screen.cursor_visible = was_visible;
-    draw_cursor();
+void print_char(char c) {
+    console_write(&c, 1);
 }
 
 void clear_screen(void) {
     if (!screen.initialized) return;
 
-    u32* end = screen.framebuffer + (screen.width * screen.height);
-    for (u32* ptr = screen.framebuffer; ptr < end; ptr++) {
-        *ptr = screen.bg_color;
+    batch_depth++;
+    
+    // Blank the visible rows; scrollback above them stays
+    cell_t blank = blank_cell();
+    for (u32 y = 0; y < screen.rows; y++) {
+        cell_t* row = live_row(y);
+        for (u32 x = 0; x < screen.cols; x++) {
+            row[x] = blank;
+        }
     }
+    view_offset = 0;
+    
+    // One fill covers the cells and the strip below the last row
+    fill_rect(0, 0, screen.width, screen.height, screen.bg_color);
+    for (u32 i = 0; i < screen.cols * screen.rows; i++) {
+        drawn[i] = blank;
+    }
+    cursor_shown = FALSE;
 
     screen.cursor_x = 0;
     screen.cursor_y = 0;
     screen.cursor_visible = TRUE;
     last_blink_tick = timer_get_ticks();  // Start the blink timer
-    draw_cursor();
-}
-
-static void scroll_screen(void) {
-    if (!screen.initialized) return;
     
-    u32* src = screen.framebuffer + (screen.width * (u32)FONT_HEIGHT);
-    u32* dest = screen.framebuffer;
-    u32 size = (screen.height - (u32)FONT_HEIGHT) * screen.width;
-    
-    for (u32 i = 0; i < size; i++) {
-        dest[i] = src[i];
-    }
-    
-    dest = screen.framebuffer + ((screen.height - (u32)FONT_HEIGHT) * screen.width);
-    for (u32 i = 0; i < screen.width * (u32)FONT_HEIGHT; i++) {
-        dest[i] = screen.bg_color;
-    }
-    
-    screen.cursor_y--;
+    batch_depth--;
+    present();
 }
 
 void print_string(const char* str) {
-    if (!screen.initialized || !str) return;
+    if (!str) return;
     
-    while (*str) {
-        print_char(*str++);
+    size_t len = 0;
+    while (str[len]) {
+        len++;
     }
+    console_write(str, len);
 }
 
 void set_colors(u32 fg, u32 bg) {
     screen.fg_color = fg;
     screen.bg_color = bg;
+    fg_index = palette_index(fg);
+    bg_index = palette_index(bg);
 }
 
 void set_cursor(u32 x, u32 y) {
     if (!screen.initialized) return;
 
-    if (x < MAX_COLS && y < MAX_ROWS) {
-        // Hide cursor at old position
-        boolean was_visible = screen.cursor_visible;
-        screen.cursor_visible = FALSE;
-        draw_cursor();
-
-        // Update position
+    if (x < screen.cols && y < screen.rows) {
+        // The bar follows on the next render without disrupting the blink
         screen.cursor_x = x;
         screen.cursor_y = y;
+        present();
+    }
+}
 
-        // Restore visibility at new position without disrupting blink
-        screen.cursor_visible = was_visible;
-        draw_cursor();
+// Look back through (lines > 0) or return towards (lines < 0) the output
+// that scrolled off the top
+void screen_scroll_view(i32 lines) {
+    if (!screen.initialized) return;
+
+    i32 offset = (i32)view_offset + lines;
+    if (offset < 0) offset = 0;
+    if (offset > (i32)history_rows) offset = history_rows;
+    
+    if ((u32)offset != view_offset) {
+        view_offset = offset;
+        mark_rows_dirty();
+        present();
     }
 }
 
+// Repaint everything from the grid, e.g. after the mode changed
+void screen_redraw(void) {
+    if (!screen.initialized) return;
+
+    batch_depth++;
+    fill_rect(0, 0, screen.width, screen.height, screen.bg_color);
+    invalidate_drawn();
+    batch_depth--;
+    present();
+}
+
 void get_screen_dimensions(u32* width, u32* height) {
     if (width) *width = screen.width;
     if (height) *height = screen.height;
 }
 
+// Physical framebuffer address and size in bytes (0 if the screen is not up).
+// With hardware scrolling this is the whole virtual framebuffer.
+u32 screen_get_framebuffer(u32* size) {
+    if (size) *size = screen.pitch * (dispi_active ? dispi_lines : screen.height);
+    return screen.initialized ? screen.fb_phys : 0;
+}
+
+// Draw through a new mapping of the framebuffer, e.g. paging's window
+void screen_set_framebuffer_mapping(u32* virt) {
+    screen.framebuffer = virt;
+}
+
+// Framebuffer fill speed in MB/s. Runs over the rows below the cursor line,
+// which already hold the background colour, so nothing visibly changes.
+u32 screen_fill_bandwidth(void) {
+    if (!screen.initialized) return 0;
+
+    u32 first_y = (screen.cursor_y + 1) * CELL_HEIGHT;
+    if (first_y >= screen.height) return 0;
+
+    u32 bytes = (screen.height - first_y) * screen.width * sizeof(u32) * FILL_BENCH_PASSES;
+
+    uint64_t t0 = read_tsc();
+    for (u32 pass = 0; pass < FILL_BENCH_PASSES; pass++) {
+        for (u32 y = first_y; y < screen.height; y++) {
+            volatile u32* line = (volatile u32*)((u8*)screen.framebuffer +
+                                                 (pan_row * CELL_HEIGHT + y) * screen.pitch);
+            for (u32 x = 0; x < screen.width; x++) {
+                line[x] = screen.bg_color;
+            }
+        }
+    }
+    uint64_t t1 = read_tsc();
+
+    // Bytes per microsecond is MB/s
+    u32 us = timer_cycles_to_ns((u32)(t1 - t0)) / 1000;
+    return bytes / (us ? us : 1);
+}
+
 // Force blink immediately - this is called directly by timer interrupt
 void screen_timer_tick(void) {
     if (!screen.initialized) return;
@@ -340,9 +1081,10 @@ void screen_timer_tick(void) {
         last_blink_tick = current_tick;
         blink_count++;
         
-        // Draw cursor with new visibility
-        draw_cursor();
     }
+    
+    // Draws the cursor in its new state and flushes whatever a print left
+    present();
 }
 
 // Alternative approach in case screen_timer_tick isn't being called properly
@@ -362,7 +1104,7 @@ void update_cursor_state(void) {
         blink_count++;
         
         // Force redraw of cursor with new visibility
-        draw_cursor();
+        present();
     }
 }
 
@@ -422,7 +1164,7 @@ void debug_cursor_blink(void) {
     for (int blink = 0; blink < 6; blink++) {
         // Toggle cursor visibility
         screen.cursor_visible = !screen.cursor_visible;
-        draw_cursor();
+        present();
         
         // Sleep for exactly one blink interval
         timer_sleep(CURSOR_BLINK_MS / (1000 / TIMER_HZ));
@@ -446,6 +1188,55 @@ void debug_cursor_blink(void) {
     print_string("Blink test complete.\n");
 }
 
+// Print more lines than the ring holds and check that every row the
+// console can show maps inside the cell array, then that the text survived
+void debug_console_ring(void) {
+    u32 lines = ring_rows * 2 + screen.rows;
+    u32 bad_rows = 0;
+    u32 checked = 0;
+    const u32 cell_rows = ring_rows;
+    
+    for (u32 i = 0; i < lines; i++) {
+        print_string("ring test line ");
+        print_int(i);
+        print_string("\n");
+        
+        for (u32 y = 0; y < screen.rows; y++) {
+            u32 live = (u32)(live_row(y) - cells) / screen.cols;
+            view_offset = history_rows;
+            u32 oldest = (u32)(view_row(y) - cells) / screen.cols;
+            view_offset = 0;
+            u32 newest = (u32)(view_row(y) - cells) / screen.cols;
+            if (live >= cell_rows || oldest >= cell_rows || newest >= cell_rows) {
+                bad_rows++;
+            }
+            checked++;
+        }
+    }
+    
+    // The last numbered line sits just above the cursor row
+    const char* expect = "ring test line ";
+    const cell_t* row = live_row(screen.cursor_y - 1);
+    boolean intact = TRUE;
+    for (u32 x = 0; expect[x]; x++) {
+        if (row[x].ch != (u8)expect[x]) {
+            intact = FALSE;
+        }
+    }
+    
+    print_string("Ring rows: ");
+    print_int(ring_rows);
+    print_string(", lines written: ");
+    print_int(lines);
+    print_string(", rows checked: ");
+    print_int(checked);
+    print_string("\nOut of range rows: ");
+    print_int(bad_rows);
+    print_string(", last line intact: ");
+    print_string(intact ? "yes" : "NO");
+    print_string("\n");
+}
+
 // Add this new function to directly control cursor visibility
 void set_cursor_visibility(boolean visible) {
     if (!screen.initialized) return;
@@ -453,6 +1244,6 @@ void set_cursor_visibility(boolean visible) {
     // Only redraw if visibility is changing
     if (visible != screen.cursor_visible) {
         screen.cursor_visible = visible;
-        draw_cursor();
+        present();
     }
 }
\ No newline at end of file
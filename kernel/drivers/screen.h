@@ -1,12 +1,14 @@
 // =============================================================================
 // Screen Driver Interface
 // Date: 2025-03-01 19:32:49 UTC
-// Purpose: VBE display driver interface for 1024x768 resolution
+// Purpose: VBE display driver interface (mode set by the boot loader)
 // =============================================================================
 
 #ifndef SCREEN_H
 #define SCREEN_H
 
+#include "data/types.h" // For size_t
+
 // Basic type definitions
 typedef unsigned char  u8;
 typedef unsigned short u16;
@@ -44,12 +46,19 @@ typedef enum { FALSE = 0, TRUE = 1 } boolean;
 #define VGA_WHITE     0xFFFFFF
 
 // Function declarations
-i32  init_screen(void);           // Initialize the screen
+i32  init_screen(u32 mboot_info_addr); // Initialize the screen in the boot loader's mode
+i32  screen_enable_backbuffer(void); // Draw into RAM, flush dirty rows (after paging)
 void clear_screen(void);          // Clear the entire screen
 void print_char(char c);          // Print a single character
 void print_string(const char* s); // Print a null-terminated string
+void console_write(const char* s, size_t len); // Print len characters, one cursor update and scroll
 void set_colors(u32 fg, u32 bg);  // Set foreground and background colors
 void set_cursor(u32 x, u32 y);    // Set cursor position
+void screen_scroll_view(i32 lines); // Scroll back (lines > 0) or forward through history
+void screen_redraw(void);         // Repaint the whole console from its cell grid
+u32  screen_get_framebuffer(u32* size); // Framebuffer physical address and size in bytes
+void screen_set_framebuffer_mapping(u32* virt); // Virtual address to draw through from now on
+u32  screen_fill_bandwidth(void);       // Measured fill speed in MB/s
 
 // Add these function declarations with the correct boolean type
 void set_cursor_visibility(boolean visible);
@@ -62,6 +71,7 @@ void force_cursor_update(void);
 
 // Debug function
 void debug_cursor_blink(void);
+void debug_console_ring(void);     // Scroll past the whole ring and check row indexes
 
 // Shell function (to fix the error)
 void shell_main(void);
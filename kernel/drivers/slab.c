@@ -0,0 +1,499 @@
+#include "mm.h"
+#include "allocprof.h"
+#include "screen.h"
+#include "data/types.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * Kernel heap: a slab allocator with one cache per size class.
+ *
+ * Every slab is a naturally aligned run of frames from alloc_pages() that
+ * starts with a slab_t header followed by equally sized objects. Free objects
+ * are chained through their first word, so allocation and free are a list
+ * pop/push. Requests bigger than the largest class go to the general-purpose
+ * heap in heap.c; really big ones, or any made before paging is up, get their
+ * own page run with a small large_hdr_t in front of the object.
+ */
+
+#define SLAB_MAGIC       0x51AB51ABUL
+#define LARGE_MAGIC      0x1A46E0B1UL
+#define SLAB_MAX_ORDER   2          // Slabs are at most 4 pages (16KB)
+#define SLAB_MIN_OBJECTS 4          // Grow the slab until at least this many objects fit
+#define SLAB_ALIGN       16         // Every object is 16-byte aligned
+#define MAX_SLAB_SIZE    2048       // Largest size served from a cache
+#define MAX_HEAP_SIZE    (64 * 1024) // Largest size served from the general-purpose heap
+
+// Header at the start of every slab
+typedef struct slab {
+    uint32_t magic;             // SLAB_MAGIC
+    struct slab* self;          // Points to itself, guards against stray magic values
+    struct slab* next;          // Next slab in the cache's partial/full list
+    struct slab* prev;          // Previous slab in the same list
+    void* free_list;            // First free object in this slab
+    uint16_t in_use;            // Objects currently handed out
+    uint16_t capacity;          // Objects that fit in this slab
+    uint8_t cache_index;        // Owning size class
+    uint8_t order;              // Slab spans 2^order frames
+    uint8_t on_full_list;       // 1 while the slab sits on the full list
+    uint8_t reserved;
+} slab_t;
+
+#define SLAB_HEADER_SIZE ((sizeof(slab_t) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+// Header in front of a large (page-backed) allocation
+typedef struct large_hdr {
+    uint32_t magic;             // LARGE_MAGIC
+    struct large_hdr* self;     // Points to itself
+    uint32_t size;              // Requested size in bytes
+    uint32_t order;             // Allocation spans 2^order frames
+} large_hdr_t;
+
+#define LARGE_HEADER_SIZE ((sizeof(large_hdr_t) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+// Per size-class cache
+typedef struct {
+    uint32_t object_size;       // Object size in bytes
+    uint32_t slab_order;        // Frames per slab (as an order)
+    uint32_t objects_per_slab;  // Objects carved from each slab
+    slab_t* partial;            // Slabs with at least one free object
+    slab_t* full;               // Slabs with no free objects
+    slab_t* empty;              // One fully free slab kept to avoid frame ping-pong
+    uint32_t slabs;             // Slabs owned, on any list or cached
+    uint32_t in_use;            // Objects handed out across all slabs
+} slab_cache_t;
+
+// Size classes: powers of two plus the odd 1.5x steps between them
+static const uint32_t size_classes[HEAP_SIZE_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+#define NUM_SIZE_CLASSES HEAP_SIZE_CLASSES
+
+static slab_cache_t caches[NUM_SIZE_CLASSES];
+
+// Maps (size + 15) / 16 to a cache index, so class lookup is one load
+static uint8_t class_lookup[MAX_SLAB_SIZE / SLAB_ALIGN + 1];
+
+static boolean slab_ready = FALSE;
+static uint32_t heap_pages = 0;     // Frames currently owned by the heap
+
+// Running totals, updated on every allocation and free
+static uint32_t live_objects = 0;
+static uint32_t live_bytes = 0;
+static uint32_t large_objects = 0;
+static uint32_t general_objects = 0;
+static uint32_t peak_objects = 0;
+static uint32_t peak_bytes = 0;
+static uint32_t peak_pages = 0;
+
+static inline void account_alloc(uint32_t bytes) {
+    live_objects++;
+    live_bytes += bytes;
+    if (live_objects > peak_objects) {
+        peak_objects = live_objects;
+    }
+    if (live_bytes > peak_bytes) {
+        peak_bytes = live_bytes;
+    }
+}
+
+static inline void account_free(uint32_t bytes) {
+    live_objects--;
+    live_bytes -= bytes;
+}
+
+static inline void account_pages(uint32_t order) {
+    heap_pages += 1UL << order;
+    if (heap_pages > peak_pages) {
+        peak_pages = heap_pages;
+    }
+}
+
+/* Initialization */
+static void slab_init(void) {
+    uint32_t cls = 0;
+    for (uint32_t i = 0; i <= MAX_SLAB_SIZE / SLAB_ALIGN; i++) {
+        while (size_classes[cls] < i * SLAB_ALIGN) {
+            cls++;
+        }
+        class_lookup[i] = (uint8_t)cls;
+    }
+
+    for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        slab_cache_t* cache = &caches[i];
+        cache->object_size = size_classes[i];
+        cache->partial = NULL;
+        cache->full = NULL;
+        cache->empty = NULL;
+        cache->slabs = 0;
+        cache->in_use = 0;
+
+        // Pick the smallest slab that holds enough objects
+        uint32_t order = 0;
+        while (order < SLAB_MAX_ORDER &&
+               ((PAGE_SIZE << order) - SLAB_HEADER_SIZE) / cache->object_size < SLAB_MIN_OBJECTS) {
+            order++;
+        }
+        cache->slab_order = order;
+        cache->objects_per_slab = ((PAGE_SIZE << order) - SLAB_HEADER_SIZE) / cache->object_size;
+    }
+
+    slab_ready = TRUE;
+}
+
+/* Slab list helpers */
+static inline void slab_list_remove(slab_t** head, slab_t* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static inline void slab_list_push(slab_t** head, slab_t* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+// Grab frames for a new slab and thread all of its objects onto the free list
+static slab_t* slab_create(uint32_t cache_index) {
+    slab_cache_t* cache = &caches[cache_index];
+    slab_t* slab = (slab_t*)alloc_pages(cache->slab_order);
+    if (slab == NULL) {
+        return NULL;
+    }
+    account_pages(cache->slab_order);
+    cache->slabs++;
+
+    slab->magic = SLAB_MAGIC;
+    slab->self = slab;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->in_use = 0;
+    slab->capacity = (uint16_t)cache->objects_per_slab;
+    slab->cache_index = (uint8_t)cache_index;
+    slab->order = (uint8_t)cache->slab_order;
+    slab->on_full_list = 0;
+    slab->reserved = 0;
+
+    // Build the free list back to front so objects come out in address order
+    uint8_t* objects = (uint8_t*)slab + SLAB_HEADER_SIZE;
+    void* head = NULL;
+    for (uint32_t i = cache->objects_per_slab; i > 0; i--) {
+        void** obj = (void**)(objects + (i - 1) * cache->object_size);
+        *obj = head;
+        head = obj;
+    }
+    slab->free_list = head;
+
+    return slab;
+}
+
+static void slab_destroy(slab_t* slab) {
+    slab->magic = 0;
+    slab->self = NULL;
+    heap_pages -= 1UL << slab->order;
+    caches[slab->cache_index].slabs--;
+    free_pages(slab, slab->order);
+}
+
+// Find the slab that owns ptr, or NULL if ptr is not a slab object
+static slab_t* slab_from_object(void* ptr) {
+    for (uint32_t order = 0; order <= SLAB_MAX_ORDER; order++) {
+        slab_t* slab = (slab_t*)((uint32_t)ptr & ~((PAGE_SIZE << order) - 1));
+        if (slab->magic == SLAB_MAGIC && slab->self == slab && slab->order == order &&
+            (uint8_t*)ptr >= (uint8_t*)slab + SLAB_HEADER_SIZE) {
+            return slab;
+        }
+    }
+    return NULL;
+}
+
+// Find the header of a large allocation, or NULL if ptr is not one
+static large_hdr_t* large_from_object(void* ptr) {
+    if (((uint32_t)ptr & (PAGE_SIZE - 1)) != LARGE_HEADER_SIZE) {
+        return NULL;
+    }
+
+    large_hdr_t* hdr = (large_hdr_t*)((uint8_t*)ptr - LARGE_HEADER_SIZE);
+    if (hdr->magic == LARGE_MAGIC && hdr->self == hdr) {
+        return hdr;
+    }
+    return NULL;
+}
+
+/* Allocation paths */
+static void* slab_alloc(uint32_t cache_index) {
+    slab_cache_t* cache = &caches[cache_index];
+    slab_t* slab = cache->partial;
+
+    if (slab == NULL) {
+        // Reuse the cached empty slab before asking for new frames
+        if (cache->empty) {
+            slab = cache->empty;
+            cache->empty = NULL;
+        } else {
+            slab = slab_create(cache_index);
+            if (slab == NULL) {
+                return NULL;
+            }
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+
+    void** obj = (void**)slab->free_list;
+    slab->free_list = *obj;
+    slab->in_use++;
+    cache->in_use++;
+    account_alloc(cache->object_size);
+
+    // Move exhausted slabs off the partial list so the head always has room
+    if (slab->free_list == NULL) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+        slab->on_full_list = 1;
+    }
+
+    return obj;
+}
+
+static void slab_free(slab_t* slab, void* ptr) {
+    slab_cache_t* cache = &caches[slab->cache_index];
+
+    void** obj = (void**)ptr;
+    *obj = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->in_use--;
+    account_free(cache->object_size);
+
+    if (slab->on_full_list) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+        slab->on_full_list = 0;
+    }
+
+    if (slab->in_use == 0) {
+        slab_list_remove(&cache->partial, slab);
+        if (cache->empty == NULL) {
+            cache->empty = slab;
+        } else {
+            slab_destroy(slab);
+        }
+    }
+}
+
+static void* large_alloc(size_t size) {
+    uint32_t pages = (size + LARGE_HEADER_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t order = 0;
+    while ((1UL << order) < pages) {
+        order++;
+    }
+    if (order > MAX_PAGE_ORDER) {
+        return NULL;
+    }
+
+    large_hdr_t* hdr = (large_hdr_t*)alloc_pages(order);
+    if (hdr == NULL) {
+        return NULL;
+    }
+    account_pages(order);
+    large_objects++;
+    account_alloc(size);
+
+    hdr->magic = LARGE_MAGIC;
+    hdr->self = hdr;
+    hdr->size = size;
+    hdr->order = order;
+    return (uint8_t*)hdr + LARGE_HEADER_SIZE;
+}
+
+static void large_free(large_hdr_t* hdr) {
+    hdr->magic = 0;
+    hdr->self = NULL;
+    heap_pages -= 1UL << hdr->order;
+    large_objects--;
+    account_free(hdr->size);
+    free_pages(hdr, hdr->order);
+}
+
+/* Public heap interface */
+static void* kmalloc_raw(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (!slab_ready) {
+        slab_init();
+    }
+
+    if (size <= MAX_SLAB_SIZE) {
+        return slab_alloc(class_lookup[(size + SLAB_ALIGN - 1) / SLAB_ALIGN]);
+    }
+    if (size <= MAX_HEAP_SIZE) {
+        void* ptr = heap_alloc(size);
+        if (ptr != NULL) {
+            general_objects++;
+            account_alloc(heap_usable_size(ptr));
+            return ptr;
+        }
+    }
+    return large_alloc(size);
+}
+
+// The profiler charges each block to the caller of the public entry point,
+// hence __builtin_return_address in every one of them
+void* kmalloc(size_t size) {
+    void* ptr = kmalloc_raw(size);
+    if (allocprof_active && ptr != NULL) {
+        allocprof_alloc(ptr, size, __builtin_return_address(0));
+    }
+    return ptr;
+}
+
+void* kcalloc(size_t nmemb, size_t size) {
+    if (nmemb != 0 && size > (size_t)-1 / nmemb) {
+        return NULL; // Multiplication would overflow
+    }
+
+    size_t total = nmemb * size;
+    void* ptr = kmalloc_raw(total);
+    if (ptr != NULL) {
+        memset(ptr, 0, total);
+        if (allocprof_active) {
+            allocprof_alloc(ptr, total, __builtin_return_address(0));
+        }
+    }
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (ptr == NULL || !slab_ready) {
+        return;
+    }
+    if (allocprof_active) {
+        allocprof_free(ptr);
+    }
+
+    if (heap_owns(ptr)) {
+        // Read the size first; the block header is gone once it is freed
+        size_t bytes = heap_usable_size(ptr);
+        if (heap_free(ptr)) {
+            general_objects--;
+            account_free(bytes);
+        }
+        return;
+    }
+
+    large_hdr_t* hdr = large_from_object(ptr);
+    if (hdr != NULL) {
+        large_free(hdr);
+        return;
+    }
+
+    slab_t* slab = slab_from_object(ptr);
+    if (slab != NULL) {
+        slab_free(slab, ptr);
+        return;
+    }
+
+    print_string("kfree: ignoring pointer not owned by the heap\n");
+}
+
+void* krealloc(void* ptr, size_t size) {
+    if (ptr == NULL) {
+        void* new_ptr = kmalloc_raw(size);
+        if (allocprof_active && new_ptr != NULL) {
+            allocprof_alloc(new_ptr, size, __builtin_return_address(0));
+        }
+        return new_ptr;
+    }
+    if (size == 0) {
+        kfree(ptr);
+        return NULL;
+    }
+
+    // Work out how much the current block can hold
+    size_t capacity;
+    large_hdr_t* hdr = NULL;
+    if (heap_owns(ptr)) {
+        capacity = heap_usable_size(ptr);
+    } else if ((hdr = large_from_object(ptr)) != NULL) {
+        capacity = (PAGE_SIZE << hdr->order) - LARGE_HEADER_SIZE;
+    } else {
+        slab_t* slab = slab_from_object(ptr);
+        if (slab == NULL) {
+            return NULL;
+        }
+        capacity = caches[slab->cache_index].object_size;
+    }
+
+    if (size <= capacity) {
+        // Heap and slab blocks are counted by capacity, which is unchanged;
+        // large blocks are counted by the size asked for
+        if (hdr != NULL) {
+            account_free(hdr->size);
+            account_alloc(size);
+            hdr->size = size;
+        }
+        if (allocprof_active) {
+            // Replaces the block's record, as a move would
+            allocprof_alloc(ptr, size, __builtin_return_address(0));
+        }
+        return ptr;
+    }
+
+    void* new_ptr = kmalloc_raw(size);
+    if (new_ptr == NULL) {
+        return NULL; // Original block stays valid
+    }
+    if (allocprof_active) {
+        allocprof_alloc(new_ptr, size, __builtin_return_address(0));
+    }
+    memcpy(new_ptr, ptr, capacity);
+    kfree(ptr);
+    return new_ptr;
+}
+
+uint32_t kmalloc_footprint(void) {
+    return heap_pages * PAGE_SIZE + heap_mapped_bytes();
+}
+
+void kmalloc_get_stats(heap_stats_t* stats) {
+    if (stats == NULL) {
+        return;
+    }
+    if (!slab_ready) {
+        slab_init();
+    }
+
+    stats->live_objects = live_objects;
+    stats->live_bytes = live_bytes;
+    stats->large_objects = large_objects;
+    stats->general_objects = general_objects;
+    stats->general_mapped = heap_mapped_bytes();
+    stats->general_free = heap_free_bytes();
+    stats->heap_pages = heap_pages;
+    stats->peak_objects = peak_objects;
+    stats->peak_bytes = peak_bytes;
+    stats->peak_pages = peak_pages;
+
+    for (uint32_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        stats->classes[i].object_size = caches[i].object_size;
+        stats->classes[i].slabs = caches[i].slabs;
+        stats->classes[i].in_use = caches[i].in_use;
+        stats->classes[i].capacity = caches[i].slabs * caches[i].objects_per_slab;
+    }
+}
@@ -6,6 +6,7 @@ extern timer_ticks
 section .text
 global timer_hw_init
 global timer_wait_next_tick
+global read_tsc
 
 ; Simple hardware init - just basic setup
 timer_hw_init:
@@ -34,4 +35,10 @@ timer_wait_next_tick:
     pop ebp
     ret
 
+; Read the time stamp counter
+; uint64_t read_tsc(void);  - result returned in EDX:EAX
+read_tsc:
+    rdtsc
+    ret
+
 section .note.GNU-stack noalloc noexec nowrite progbits
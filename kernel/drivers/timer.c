@@ -14,6 +14,11 @@ static boolean hw_timer_available = FALSE;
 static int debug_level = TIMER_DEBUG_NONE;
 static boolean safe_mode = TRUE;
 
+// TSC frequency in kHz (cycles per millisecond), 0 until calibrated
+static uint32_t tsc_khz = 0;
+
+#define TSC_CALIBRATE_MS 10
+
 void timer_set_debug_level(int level) {
     if (level >= TIMER_DEBUG_NONE && level <= TIMER_DEBUG_ALL) {
         debug_level = level;
@@ -160,3 +165,57 @@ void timer_disable(void) {
     timer_active = FALSE;
     hw_timer_available = FALSE;
 }
+
+// Measure the TSC against a 10ms one-shot countdown on PIT channel 2.
+// Channel 2 only drives the speaker, so this does not disturb the tick timer.
+static void tsc_calibrate(void) {
+    uint32_t count = PIT_FREQUENCY * TSC_CALIBRATE_MS / 1000;
+    
+    // Gate high, speaker off
+    outb(PIT_GATE_PORT, (inb(PIT_GATE_PORT) & ~0x02) | 0x01);
+    
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(PIT_COMMAND, 0xB0);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+    
+    uint64_t start = read_tsc();
+    uint32_t spins = 0;
+    while (!(inb(PIT_GATE_PORT) & 0x20)) {
+        if (++spins > 10000000) {
+            break; // Channel 2 not responding, keep the estimate below
+        }
+    }
+    uint64_t end = read_tsc();
+    
+    tsc_khz = (uint32_t)(end - start) / TSC_CALIBRATE_MS;
+    if (tsc_khz == 0) {
+        tsc_khz = 1;
+    }
+}
+
+uint32_t timer_tsc_khz(void) {
+    if (tsc_khz == 0) {
+        tsc_calibrate();
+    }
+    return tsc_khz;
+}
+
+// Convert a TSC cycle count to nanoseconds (result must fit in 32 bits)
+uint32_t timer_cycles_to_ns(uint32_t cycles) {
+    uint64_t scaled = (uint64_t)cycles * 1000000ULL;
+    uint32_t khz = timer_tsc_khz();
+    
+    // Divide with a single divl so we do not depend on libgcc's __udivdi3
+    uint32_t high = (uint32_t)(scaled >> 32);
+    if (high >= khz) {
+        return 0xFFFFFFFF; // Quotient would not fit
+    }
+    
+    uint32_t quotient, remainder;
+    __asm__("divl %4"
+            : "=a"(quotient), "=d"(remainder)
+            : "a"((uint32_t)scaled), "d"(high), "rm"(khz));
+    (void)remainder;
+    return quotient;
+}
@@ -17,6 +17,7 @@
 #define PIT_CHANNEL0    0x40
 #define PIT_CHANNEL1    0x41
 #define PIT_CHANNEL2    0x42
+#define PIT_GATE_PORT   0x61    // Channel 2 gate (bit 0) and output (bit 5)
 
 // Operating modes
 #define PIT_MODE_RATE   0x34    // Rate generator mode
@@ -49,6 +50,10 @@ int timer_enable(void);
 void timer_disable(void);
 void print_int(int value);
 
+// TSC calibration (measured against PIT channel 2 on first use)
+uint32_t timer_tsc_khz(void);
+uint32_t timer_cycles_to_ns(uint32_t cycles);
+
 // Assembly helpers
 extern void timer_hw_init(void);
 extern uint64_t read_tsc(void);
@@ -0,0 +1,284 @@
+#include "zram.h"
+#include "lz4.h"
+#include "mm.h"
+#include "paging.h"
+#include "timer.h"
+#include "data/types.h"
+
+/* NULL definition */
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+/*
+ * Compressed page store.
+ *
+ * Objects of similar size share a zspage, so a 900 byte page costs about
+ * 960 bytes of memory rather than a frame. Every zspage has a descriptor
+ * with a bitmap of its slots; zspages with free slots sit on a per-class
+ * list, and a zspage is handed back once its last object goes.
+ *
+ * Backing frames come from high memory first, which the kernel cannot use
+ * for much else, and are only reached through kmap(). A handle is the
+ * descriptor index and slot number, plus one so that 0 means "none".
+ */
+
+#define ZRAM_HEADER       2             // Object length prefix
+#define ZRAM_NONE         0xFFFF        // End of a descriptor list
+#define FAULT_NS_LIMIT    0x80000000UL  // Halve the latency sums before they wrap
+
+typedef struct {
+    phys_addr_t frame;          // Backing frame, 0 while the descriptor is unused
+    uint16_t cls;               // Size class
+    uint16_t used;              // Objects stored
+    uint16_t prev;              // Neighbours on the partial or free list
+    uint16_t next;
+    uint32_t slot_map[2];       // One bit per slot in use
+} zspage_t;
+
+static zspage_t zspages[ZRAM_ZSPAGES];
+static uint16_t partial[ZRAM_CLASSES];      // Per class, zspages with a free slot
+static uint16_t free_desc = ZRAM_NONE;      // Unused descriptors (singly linked)
+static boolean zram_ready = FALSE;
+
+// Compression output before its size class is known
+static uint8_t scratch[ZRAM_MAX_OBJECT];
+
+static zram_stats_t stats;
+static uint32_t fault_ns_sum = 0;
+static uint32_t fault_ns_count = 0;
+
+static inline uint32_t class_size(uint32_t cls) {
+    return (cls + 1) * ZRAM_CLASS_STEP;
+}
+
+static inline uint32_t class_slots(uint32_t cls) {
+    return PAGE_SIZE / class_size(cls);
+}
+
+static void zram_init(void) {
+    for (uint32_t i = 0; i < ZRAM_CLASSES; i++) {
+        partial[i] = ZRAM_NONE;
+    }
+    for (uint32_t i = 0; i < ZRAM_ZSPAGES; i++) {
+        zspages[i].frame = 0;
+        zspages[i].next = (i + 1 < ZRAM_ZSPAGES) ? i + 1 : ZRAM_NONE;
+    }
+    free_desc = 0;
+    zram_ready = TRUE;
+}
+
+/* Partial lists */
+static void partial_push(uint16_t index) {
+    zspage_t* zs = &zspages[index];
+    zs->prev = ZRAM_NONE;
+    zs->next = partial[zs->cls];
+    if (zs->next != ZRAM_NONE) {
+        zspages[zs->next].prev = index;
+    }
+    partial[zs->cls] = index;
+}
+
+static void partial_unlink(uint16_t index) {
+    zspage_t* zs = &zspages[index];
+    if (zs->prev != ZRAM_NONE) {
+        zspages[zs->prev].next = zs->next;
+    } else {
+        partial[zs->cls] = zs->next;
+    }
+    if (zs->next != ZRAM_NONE) {
+        zspages[zs->next].prev = zs->prev;
+    }
+}
+
+// Start a zspage for cls; spare_frame is used when no frame can be allocated
+static int32_t zspage_create(uint32_t cls, phys_addr_t spare_frame, boolean* donated) {
+    if (free_desc == ZRAM_NONE) {
+        return -1;
+    }
+
+    phys_addr_t frame = alloc_high_frame();
+    if (frame == 0) {
+        frame = spare_frame;
+        *donated = TRUE;
+    }
+
+    uint16_t index = free_desc;
+    zspage_t* zs = &zspages[index];
+    free_desc = zs->next;
+
+    zs->frame = frame;
+    zs->cls = cls;
+    zs->used = 0;
+    zs->slot_map[0] = 0;
+    zs->slot_map[1] = 0;
+    partial_push(index);
+    stats.pool_frames++;
+    return index;
+}
+
+static void zspage_destroy(uint16_t index) {
+    zspage_t* zs = &zspages[index];
+    partial_unlink(index);
+    // The frame may be low memory, either donated by an evicted page or
+    // handed out by alloc_high_frame() falling back to the normal zone;
+    // free_high_frame() returns frames below MAX_PHYS_ADDR with free_frame()
+    free_high_frame(zs->frame);
+    zs->frame = 0;
+    zs->next = free_desc;
+    free_desc = index;
+    stats.pool_frames--;
+}
+
+/* Store interface */
+uint32_t zram_store(const void* page, phys_addr_t page_phys, boolean* donated) {
+    *donated = FALSE;
+    if (!zram_ready) {
+        zram_init();
+    }
+
+    uint32_t len = lz4_compress((const uint8_t*)page, PAGE_SIZE, scratch,
+                                ZRAM_MAX_OBJECT - ZRAM_HEADER);
+    if (len == 0) {
+        stats.rejected++;
+        return 0;
+    }
+
+    uint32_t cls = (len + ZRAM_HEADER - 1) / ZRAM_CLASS_STEP;
+    int32_t index = partial[cls];
+    boolean created = FALSE;
+    if (index == ZRAM_NONE) {
+        index = zspage_create(cls, page_phys, donated);
+        if (index < 0) {
+            stats.rejected++;
+            return 0;
+        }
+        created = TRUE;
+    }
+
+    zspage_t* zs = &zspages[index];
+    uint8_t* base = (uint8_t*)kmap(zs->frame);
+    if (base == NULL) {
+        if (created) {
+            // A donated frame goes back to its page, which keeps it
+            if (*donated) {
+                zs->frame = 0;
+                *donated = FALSE;
+                partial_unlink(index);
+                zs->next = free_desc;
+                free_desc = index;
+                stats.pool_frames--;
+            } else {
+                zspage_destroy(index);
+            }
+        }
+        stats.rejected++;
+        return 0;
+    }
+
+    uint32_t slot = (~zs->slot_map[0] != 0) ? __builtin_ctz(~zs->slot_map[0])
+                                            : 32 + __builtin_ctz(~zs->slot_map[1]);
+    uint8_t* object = base + slot * class_size(cls);
+    object[0] = (uint8_t)len;
+    object[1] = (uint8_t)(len >> 8);
+    memcpy(object + ZRAM_HEADER, scratch, len);
+    kunmap(base);
+
+    zs->slot_map[slot / 32] |= 1UL << (slot % 32);
+    if (++zs->used == class_slots(cls)) {
+        partial_unlink(index);
+    }
+
+    stats.stored_pages++;
+    stats.compressed_bytes += len;
+    return ((uint32_t)index << ZRAM_SLOT_BITS) + slot + 1;
+}
+
+// Descriptor and slot behind a handle; NULL if it names nothing stored
+static zspage_t* zram_lookup(uint32_t handle, uint32_t* slot) {
+    if (handle == 0 || !zram_ready) {
+        return NULL;
+    }
+    handle--;
+
+    uint32_t index = handle >> ZRAM_SLOT_BITS;
+    *slot = handle & ((1UL << ZRAM_SLOT_BITS) - 1);
+    if (index >= ZRAM_ZSPAGES) {
+        return NULL;
+    }
+
+    zspage_t* zs = &zspages[index];
+    if (zs->frame == 0 || !(zs->slot_map[*slot / 32] & (1UL << (*slot % 32)))) {
+        return NULL;
+    }
+    return zs;
+}
+
+boolean zram_load(uint32_t handle, void* page) {
+    uint32_t slot;
+    zspage_t* zs = zram_lookup(handle, &slot);
+    if (zs == NULL) {
+        return FALSE;
+    }
+
+    uint8_t* base = (uint8_t*)kmap(zs->frame);
+    if (base == NULL) {
+        return FALSE;
+    }
+    const uint8_t* object = base + slot * class_size(zs->cls);
+    uint32_t len = object[0] | (object[1] << 8);
+    int32_t size = lz4_decompress(object + ZRAM_HEADER, len, (uint8_t*)page, PAGE_SIZE);
+    kunmap(base);
+
+    return size == PAGE_SIZE;
+}
+
+void zram_free(uint32_t handle) {
+    uint32_t slot;
+    zspage_t* zs = zram_lookup(handle, &slot);
+    if (zs == NULL) {
+        return;
+    }
+    uint16_t index = (uint16_t)(zs - zspages);
+
+    uint8_t* base = (uint8_t*)kmap(zs->frame);
+    if (base != NULL) {
+        const uint8_t* object = base + slot * class_size(zs->cls);
+        stats.compressed_bytes -= object[0] | (object[1] << 8);
+        kunmap(base);
+    }
+    stats.stored_pages--;
+
+    zs->slot_map[slot / 32] &= ~(1UL << (slot % 32));
+    if (zs->used-- == class_slots(zs->cls)) {
+        partial_push(index); // Was full, so it was off the list
+    }
+    if (zs->used == 0) {
+        zspage_destroy(index);
+    }
+}
+
+/* Statistics */
+void zram_note_fault(uint32_t cycles) {
+    uint32_t ns = timer_cycles_to_ns(cycles);
+
+    if (fault_ns_sum + ns < fault_ns_sum || fault_ns_sum + ns >= FAULT_NS_LIMIT) {
+        fault_ns_sum >>= 1;
+        fault_ns_count >>= 1;
+    }
+    fault_ns_sum += ns;
+    fault_ns_count++;
+
+    stats.faults++;
+    if (ns > stats.fault_ns_max) {
+        stats.fault_ns_max = ns;
+    }
+}
+
+void zram_get_stats(zram_stats_t* out) {
+    if (out == NULL) {
+        return;
+    }
+    *out = stats;
+    out->fault_ns_avg = fault_ns_count ? fault_ns_sum / fault_ns_count : 0;
+}
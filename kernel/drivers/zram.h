@@ -0,0 +1,41 @@
+#ifndef ZRAM_H
+#define ZRAM_H
+
+#include "data/types.h"
+#include "screen.h" // For boolean type
+#include "mm.h"     // For phys_addr_t
+
+// Compressed pages are packed into zspages: single frames cut into equal
+// slots of one size class. Each object is a 2-byte length and LZ4 data.
+#define ZRAM_CLASS_STEP   64                                // Slot sizes go up in 64 byte steps
+#define ZRAM_MAX_OBJECT   3072                              // Pages compressing worse are kept as is
+#define ZRAM_CLASSES      (ZRAM_MAX_OBJECT / ZRAM_CLASS_STEP)
+#define ZRAM_ZSPAGES      2048                              // Descriptors, so at most 8MB of zspages
+#define ZRAM_SLOT_BITS    6                                 // Up to 64 slots per zspage
+
+// Compressed store statistics
+typedef struct {
+    uint32_t stored_pages;      // Pages held compressed
+    uint32_t compressed_bytes;  // Their LZ4 size
+    uint32_t pool_frames;       // Frames holding zspages
+    uint32_t rejected;          // Pages that did not compress well enough
+    uint32_t faults;            // Pages decompressed on a page fault
+    uint32_t fault_ns_avg;      // Time from fault to remapped page
+    uint32_t fault_ns_max;
+} zram_stats_t;
+
+// Compress a page (readable at page, backed by frame page_phys) into the
+// store. Returns a non-zero handle, or 0 if it was rejected. When no frame
+// was free for a new zspage the page's own frame becomes one; *donated is
+// then TRUE and the caller must not free it.
+uint32_t zram_store(const void* page, phys_addr_t page_phys, boolean* donated);
+
+// Decompress the object behind handle into a page; FALSE if it is corrupt
+boolean zram_load(uint32_t handle, void* page);
+void zram_free(uint32_t handle);
+
+// Record how long a compressed-page fault took to resolve
+void zram_note_fault(uint32_t cycles);
+void zram_get_stats(zram_stats_t* stats);
+
+#endif // ZRAM_H
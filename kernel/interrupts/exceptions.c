@@ -1,6 +1,7 @@
 #include "exceptions.h"
 #include "isr.h"
 #include "../drivers/screen.h"
+#include "../drivers/paging.h"
 
 // Exception state tracking variables
 static int in_exception_handler = 0;
@@ -152,6 +153,12 @@ void page_fault_handler(registers_t* regs) {
     // The CR2 register contains the address that caused the page fault
     __asm__ volatile("mov %%cr2, %0" : "=r"(fault_address));
     
+    // First touch of a demand-zero page, or a page evicted to zram: map a
+    // zeroed or decompressed frame and retry
+    if (paging_handle_fault(fault_address, regs->err_code)) {
+        return;
+    }
+    
     print_string("\n=== EXCEPTION: PAGE FAULT ===\n");
     print_string("Attempted to access memory at: ");
     exception_print_hex(fault_address);
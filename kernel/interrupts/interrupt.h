@@ -26,6 +26,25 @@ static inline int are_interrupts_enabled(void) {
     return flags & (1 << 9);
 }
 
+// Disable interrupts and return the previous EFLAGS for irq_restore()
+static inline uint32_t irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf\n\t"
+                     "pop %0\n\t"
+                     "cli"
+                     : "=r"(flags)
+                     :
+                     : "memory");
+    return flags;
+}
+
+// Re-enable interrupts only if they were on before irq_save()
+static inline void irq_restore(uint32_t flags) {
+    if (flags & (1 << 9)) {
+        __asm__ volatile("sti" : : : "memory");
+    }
+}
+
 // Enable specific IRQ
 void enable_irq(uint8_t irq_num);
 
@@ -99,6 +99,10 @@ isr_common_stub:
     mov fs, ax
     mov gs, ax
 
+    ; C code expects DF clear; the interrupted code may be in a backward
+    ; copy (iret restores its flags)
+    cld
+
     ; Call C handler
     push esp      ; Pass pointer to stack as argument
     call isr_handler
@@ -131,6 +135,10 @@ irq_common_stub:
     mov fs, ax
     mov gs, ax
 
+    ; C code expects DF clear; the interrupted code may be in a backward
+    ; copy (iret restores its flags)
+    cld
+
     ; Call C handler
     push esp      ; Pass pointer to stack as argument
     call irq_handler
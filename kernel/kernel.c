@@ -2,22 +2,27 @@
 #include "drivers/screen.h"
 #include "shell/shell.h"
 #include "drivers/mm.h"
+#include "drivers/paging.h"
+#include "interrupts/interrupt.h"
+
+// Forward declaration for print_int from shell.c
+extern void print_int(int num);
 
 // Define memory size constants (matching definitions in mm.c)
 #define KB(x) ((x) * 1024UL)
 #define MB(x) (KB(x) * 1024UL)
 #define GB(x) (MB(x) * 1024UL)
 
-void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((unused))) {
+void kmain(unsigned long mem_size, unsigned long mboot_info_addr) {
     // Memory size validation - set sane limits but don't artificially cap
     if (mem_size < 4 * 1024 * 1024) {
         mem_size = 4 * 1024 * 1024;  // Minimum 4MB
     } 
     else if (mem_size > 0xF0000000) {
-        mem_size = 0xF0000000;  // Cap at ~4GB for 32-bit addressing
+        mem_size = 0xF0000000;  // Boot estimate only; mm_init finds RAM above 4GB in the memory map
     }
 
-    if (init_screen() != SCREEN_SUCCESS) {
+    if (init_screen(mboot_info_addr) != SCREEN_SUCCESS) {
         return;
     }
 
@@ -44,7 +49,7 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
     print_string(" MB\n");
     
     print_string("Initializing memory management...\n");
-    int mm_result = mm_init(mem_size); // Pass the actual memory size
+    int mm_result = mm_init(mem_size, mboot_info_addr); // Seed from the memory map
     
     if (mm_result != MM_SUCCESS) {
         print_string("ERROR: Failed to initialize memory management (code ");
@@ -62,11 +67,34 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
         print_string(")\n");
         
         print_string("Retrying with conservative memory settings...\n");
-        if (mm_init(4 * 1024 * 1024) != MM_SUCCESS) {
+        if (mm_init(4 * 1024 * 1024, 0) != MM_SUCCESS) {
             print_string("FATAL: Memory initialization failed. System halted.\n");
             return;
         }
     }
+    
+    mm_benchmark();
+    
+    print_string("Enabling paging...\n");
+    u32 fb_fill_before = screen_fill_bandwidth(); // Boot mappings: uncached
+    if (paging_init() != MM_SUCCESS) {
+        print_string("WARNING: Could not set up kernel page tables, staying on the boot mappings\n");
+    } else if (paging_write_combining()) {
+        u32 fb_fill_after = screen_fill_bandwidth();
+        print_string("Framebuffer fill: ");
+        print_int(fb_fill_before);
+        print_string(" MB/s uncached, ");
+        print_int(fb_fill_after);
+        print_string(" MB/s write-combining\n");
+    }
+
+    // Exceptions must be live before anything touches demand-zero memory
+    interrupt_init();
+
+    // From here on the console draws into RAM and flushes dirty rows
+    if (screen_enable_backbuffer() != SCREEN_SUCCESS) {
+        print_string("WARNING: No console back buffer, drawing straight to the framebuffer\n");
+    }
 
     print_string("Initializing keyboard...\n");
     init_keyboard();
@@ -79,11 +107,15 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
     mem_info_t info;
     get_memory_info(&info);
     
+    // Work in KB: the byte counts are 64-bit and there is no 64-bit division
+    uint32_t total_kb = (uint32_t)(info.total_memory >> 10);
+    uint32_t free_kb = (uint32_t)(info.free_memory >> 10);
+    
     // Choose appropriate unit based on size
-    if (info.total_memory >= GB(1)) {
+    if (total_kb >= MB(1)) {
         // Display as GB with decimal place for larger memory sizes
-        uint32_t gb_whole = info.total_memory / GB(1);
-        uint32_t gb_fraction = ((info.total_memory % GB(1)) * 100) / GB(1);
+        uint32_t gb_whole = total_kb / MB(1);
+        uint32_t gb_fraction = ((total_kb % MB(1)) * 100) / MB(1);
         
         print_string("Memory: ");
         // Removing the unused mem_buf variable
@@ -141,7 +173,7 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
         print_string(" GB (");
     } else {
         // Display as MB for smaller memory
-        uint32_t mem_mb = info.total_memory / MB(1);
+        uint32_t mem_mb = total_kb / KB(1);
         
         // Convert to string
         char mem_mb_str[16];
@@ -171,13 +203,13 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
     
     // Calculate free memory percentage using 32-bit math
     uint32_t free_percent;
-    if (info.total_memory > 0) {
+    if (total_kb > 0) {
         // Avoid overflow by scaling values if needed
-        if (info.free_memory <= 429496729 && info.total_memory <= 429496729) { 
-            free_percent = (info.free_memory * 100) / info.total_memory;
+        if (total_kb <= 42949672) { 
+            free_percent = (free_kb * 100) / total_kb;
         } else {
-            uint32_t scaled_free = info.free_memory / KB(1);
-            uint32_t scaled_total = info.total_memory / KB(1);
+            uint32_t scaled_free = free_kb / KB(1);
+            uint32_t scaled_total = total_kb / KB(1);
             free_percent = (scaled_free * 100) / scaled_total;
         }
     } else {
@@ -221,8 +253,11 @@ void kmain(unsigned long mem_size, unsigned long mboot_info_addr __attribute__((
             // This manually forces cursor to blink by calling the existing blinking function
             force_cursor_update();
             
-            // Tiny delay to prevent CPU hogging
-            for (volatile int i = 0; i < 10000; i++);
+            // Spend idle time pre-zeroing frames; only delay once the pool is full
+            if (!mm_idle_work()) {
+                // Tiny delay to prevent CPU hogging
+                for (volatile int i = 0; i < 10000; i++);
+            }
         }
         
         char* cmd = read_line();
@@ -12,6 +12,13 @@ MULTIBOOT_CHECKSUM     equ -(MULTIBOOT_MAGIC + MULTIBOOT_FLAGS)
 STACK_SIZE             equ 32768  ; 32KB stack
 MIN_MEMORY             equ 1048576 ; Minimum 1MB memory
 KERNEL_VIRTUAL_BASE    equ 0xC0000000
+KERNEL_PDE_INDEX       equ KERNEL_VIRTUAL_BASE >> 22
+BOOT_KERNEL_PDES       equ 4      ; Boot window covers the first 16MB of RAM
+
+; Paging constants
+PDE_LARGE_RW           equ 0x83   ; Present, writable, 4MB page
+CR4_PSE                equ 0x10
+CR0_PG                 equ 0x80000000
 
 ; Error codes
 ERR_NO_MULTIBOOT      equ 0x01
@@ -48,7 +55,9 @@ stack_top:
 section .data
 align 4
 global cpu_features
-cpu_features:           dd 0
+cpu_features:           dd 0    ; CPUID leaf 1 EDX
+global cpu_features_ext
+cpu_features_ext:       dd 0    ; CPUID leaf 7 EBX
 global memory_size
 memory_size:           dd 0
 global video_mode
@@ -63,23 +72,78 @@ error_msgs:
     db 'ERR: Required CPU feature missing', 0
     db 'ERR: Invalid video mode', 0
 
+; Boot trampoline, linked at its physical address. The rest of the kernel is
+; linked at KERNEL_VIRTUAL_BASE, so paging has to be on before we touch it.
+section .boot progbits alloc exec write align=4096
+global _start
+
+; Identity maps the whole 4GB with 4MB pages, except for the kernel window at
+; KERNEL_VIRTUAL_BASE, which maps the start of physical memory instead. The
+; identity part keeps the multiboot info, low memory and the framebuffer
+; reachable until paging_init() builds the real page directory.
+align 4096
+boot_page_directory:
+    times 1024 dd 0
+
+_start:
+    ; Disable interrupts during initialization
+    cli
+    
+    ; Keep the multiboot magic (EBX holds the info pointer and is left alone)
+    mov esi, eax
+    
+    ; Identity map everything
+    mov edi, boot_page_directory
+    xor ecx, ecx
+.identity_loop:
+    mov eax, ecx
+    shl eax, 22
+    or eax, PDE_LARGE_RW
+    mov [edi + ecx*4], eax
+    inc ecx
+    cmp ecx, 1024
+    jne .identity_loop
+    
+    ; Point the kernel window at physical 0
+    xor ecx, ecx
+.kernel_loop:
+    mov eax, ecx
+    shl eax, 22
+    or eax, PDE_LARGE_RW
+    mov [edi + (KERNEL_PDE_INDEX * 4) + ecx*4], eax
+    inc ecx
+    cmp ecx, BOOT_KERNEL_PDES
+    jne .kernel_loop
+    
+    ; Turn on 4MB pages and paging
+    mov eax, cr4
+    or eax, CR4_PSE
+    mov cr4, eax
+    mov cr3, edi
+    mov eax, cr0
+    or eax, CR0_PG
+    mov cr0, eax
+    
+    ; Continue at the kernel's linked (virtual) address
+    mov eax, higher_half_start
+    jmp eax
+
 section .text
 align 4
-global _start
 extern kmain
 
 ; Memory validation and extraction - completely rewritten
 check_memory:
     pushad
     
-    ; Check if memory info is available in multiboot flags
+    ; Prefer the memory map, fall back to mem_lower/mem_upper
     mov eax, [ebx]
-    bt eax, 0           ; Test bit 0 (memory info present)
-    jc .use_mem_info    ; If set, use mem_lower/mem_upper
-    
     bt eax, 6           ; Test bit 6 (mmap info present)
     jc .use_mmap        ; If set, use memory map
     
+    bt eax, 0           ; Test bit 0 (memory info present)
+    jc .use_mem_info    ; If set, use mem_lower/mem_upper
+    
     ; If we don't have either memory info, use a conservative default
     mov dword [memory_size], 16 * 1024 * 1024  ; 16MB default
     jmp .done
@@ -101,41 +165,51 @@ check_memory:
     
 .use_mmap:
     ; Initialize memory counter
-    xor edi, edi        ; Total memory size
+    xor edi, edi        ; Total usable memory below 4GB
     
     ; Get memory map address and length
-    mov esi, [ebx + 44] ; mmap_addr
-    mov ecx, [ebx + 48] ; mmap_length
+    mov esi, [ebx + 48] ; mmap_addr
+    mov ecx, [ebx + 44] ; mmap_length
     add ecx, esi        ; End of mmap
     
+    ; Entry layout: size(+0) base_lo(+4) base_hi(+8) len_lo(+12) len_hi(+16) type(+20)
 .mmap_loop:
     cmp esi, ecx        ; Check if we've reached the end
-    jge .mmap_done
+    jae .mmap_done
     
     ; Check entry type (1 = available RAM)
-    mov edx, [esi + 16] ; entry type
-    cmp edx, 1
+    cmp dword [esi + 20], 1
     jne .next_mmap_entry
     
-    ; Get base address and length of this memory region
-    ; Note: We only use the lower 32 bits for simplicity
-    ; This should be fine for our purposes (up to 4GB RAM)
-    mov eax, [esi + 8]  ; base_addr (low)
-    mov edx, [esi + 0]  ; length (low)
+    ; This 32-bit estimate stops at 4GB; mm_init reads the whole map itself
+    ; and hands RAM above it to the PAE high memory allocator
+    cmp dword [esi + 8], 0
+    jne .next_mmap_entry
+    
+    ; Length, saturated to 32 bits
+    mov eax, [esi + 12]
+    cmp dword [esi + 16], 0
+    je .clip_region
+    mov eax, 0xFFFFFFFF
     
-    ; Add this region's size to total
-    ; But only if it starts below 4GB
-    test dword [esi + 12], 0xFFFFFFFF  ; base_addr (high)
-    jnz .next_mmap_entry  ; Skip if base_addr is >= 4GB
+.clip_region:
+    ; Clip the region at 4GB: room left is (0 - base), or everything if base == 0
+    mov edx, [esi + 4]
+    neg edx
+    jz .add_region
+    cmp eax, edx
+    jbe .add_region
+    mov eax, edx
     
-    ; For regions that start after the first 1MB:
-    add edi, edx
+.add_region:
+    add edi, eax
+    jnc .next_mmap_entry
+    mov edi, 0xFFFFFFFF ; Saturate on overflow
 
 .next_mmap_entry:
     ; Move to next entry (size + 4 bytes)
-    mov eax, [esi]      ; size field
-    add eax, 4          ; add 4 for the size field itself
-    add esi, eax        ; move to next entry
+    add esi, [esi]      ; size field
+    add esi, 4          ; add 4 for the size field itself
     jmp .mmap_loop
     
 .mmap_done:
@@ -169,6 +243,45 @@ check_memory:
     popad
     ret
 
+; CPU feature detection: fills cpu_features / cpu_features_ext
+detect_cpu_features:
+    pushad
+    
+    ; CPUID exists if EFLAGS.ID (bit 21) can be toggled
+    pushfd
+    pop eax
+    mov ecx, eax
+    xor eax, 1 << 21
+    push eax
+    popfd
+    pushfd
+    pop eax
+    push ecx
+    popfd
+    xor eax, ecx
+    jz .done            ; No CPUID: leave both slots zero
+    
+    ; Highest standard leaf
+    xor eax, eax
+    cpuid
+    mov esi, eax
+    
+    mov eax, 1
+    cpuid
+    mov [cpu_features], edx
+    
+    ; Structured extended features (ERMS lives here)
+    cmp esi, 7
+    jb .done
+    mov eax, 7
+    xor ecx, ecx
+    cpuid
+    mov [cpu_features_ext], ebx
+    
+.done:
+    popad
+    ret
+
 ; Video mode validation
 check_video_mode:
     pushad
@@ -209,12 +322,9 @@ error_handler:
     hlt
     jmp $
 
-_start:
-    ; Disable interrupts during initialization
-    cli
-    
-    ; Check multiboot signature
-    cmp eax, 0x2BADB002
+higher_half_start:
+    ; Check multiboot signature (saved in ESI by the trampoline)
+    cmp esi, 0x2BADB002
     jne .no_multiboot
     
     ; Set up stack
@@ -224,6 +334,9 @@ _start:
     ; Clear direction flag
     cld
     
+    ; Record what the CPU supports before any C code runs
+    call detect_cpu_features
+    
     ; Save multiboot info pointer
     push ebx
     
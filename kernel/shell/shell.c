@@ -1,8 +1,13 @@
+#include "shell.h"
 #include "../drivers/screen.h"
 #include "../drivers/keyboard.h"
 #include "../data/about.h"
 #include "../drivers/power.h"
 #include "../drivers/mm.h"
+#include "../drivers/paging.h"
+#include "../drivers/arena.h"
+#include "../drivers/allocprof.h"
+#include "../drivers/zram.h"
 #include "../interrupts/exceptions.h" 
 #include "../interrupts/idt_checker.h"
 #include "../drivers/timer.h"
@@ -22,6 +27,9 @@ struct HelpPage {
 // Add a static variable to track debug mode
 static boolean debug_mode = FALSE;
 
+// Scratch memory for the running command, emptied when it returns
+static arena_t command_arena;
+
 // Restructured help pages with vertical formatting
 // Standard commands only (page 1)
 struct HelpPage help_pages[2] = {
@@ -47,7 +55,7 @@ struct HelpPage help_pages[2] = {
             "Shutdown computer",
             "Restart computer",
             "R00T (Joke Command)",
-            "Show memory info [--kb]"
+            "Show memory info [--kb] [--verbose]"
         }
     },
     // Page 2 - Debug commands (only shown in debug mode)
@@ -59,7 +67,7 @@ struct HelpPage help_pages[2] = {
             "irqtest",
             "exception",
             "sysdiag",
-            "",
+            "allocs",
             "",
             ""
         },
@@ -70,7 +78,7 @@ struct HelpPage help_pages[2] = {
             "Test IRQ handling (timer sleep)",
             "Trigger a test exception",
             "Run system diagnostics",
-            "",
+            "Alloc profile [top [n]|snapshot|leaks]",
             "",
             ""
         }
@@ -302,6 +310,100 @@ void test_irq_handling(void) {
     }
 }
 
+// Reserve a demand-zero region, touch part of it and show what got committed
+void test_lazy_pages(void) {
+    const uint32_t size = 4 * 1024 * 1024;
+    const uint32_t stride = 16 * PAGE_SIZE;
+    
+    uint8_t* region = (uint8_t*)vm_reserve(size, PAGE_WRITE);
+    if (!region) {
+        print_string("Could not reserve a demand-zero region\n");
+        return;
+    }
+    
+    vm_stats_t before, after;
+    vm_get_stats(&before);
+    
+    boolean zeroed = TRUE;
+    for (uint32_t offset = 0; offset < size; offset += stride) {
+        if (region[offset] != 0) {
+            zeroed = FALSE;
+        }
+        region[offset] = 0xA5;
+    }
+    vm_get_stats(&after);
+    
+    print_string("Reserved ");
+    print_int(size / 1024);
+    print_string(" KB at ");
+    print_hex((uint32_t)region);
+    print_string(", touched every ");
+    print_int(stride / 1024);
+    print_string(" KB\n");
+    print_string("Minor faults: ");
+    print_int(after.minor_faults - before.minor_faults);
+    print_string(", committed: ");
+    print_int((after.committed_bytes - before.committed_bytes) / 1024);
+    print_string(" KB, pages read as zero: ");
+    print_string(zeroed ? "yes" : "NO");
+    print_string("\n");
+    
+    vm_release(region);
+}
+
+// Fill a region, push it all into zram, then fault it back and check it
+void test_zram_pages(void) {
+    const uint32_t size = 1024 * 1024;
+    const uint32_t pages = size / PAGE_SIZE;
+    
+    uint32_t* region = (uint32_t*)vm_reserve(size, PAGE_WRITE);
+    if (!region) {
+        print_string("Could not reserve a demand-zero region\n");
+        return;
+    }
+    
+    // Compressible but distinct: a counter that repeats every 64 words
+    for (uint32_t i = 0; i < size / 4; i++) {
+        region[i] = (i / 1024) * 0x10001 + (i % 64);
+    }
+    
+    vm_stats_t before, after;
+    zram_stats_t zs;
+    vm_get_stats(&before);
+    
+    // The pages were just written, so the clock takes a turn to age them
+    uint32_t evicted = vm_reclaim(pages);
+    zram_get_stats(&zs);
+    
+    print_string("Evicted ");
+    print_int(evicted);
+    print_string(" of ");
+    print_int(pages);
+    print_string(" pages into ");
+    print_int(zs.compressed_bytes / 1024);
+    print_string(" KB of zram\n");
+    
+    boolean intact = TRUE;
+    for (uint32_t i = 0; i < size / 4; i++) {
+        if (region[i] != (i / 1024) * 0x10001 + (i % 64)) {
+            intact = FALSE;
+            break;
+        }
+    }
+    vm_get_stats(&after);
+    zram_get_stats(&zs);
+    
+    print_string("Major faults: ");
+    print_int(after.major_faults - before.major_faults);
+    print_string(", avg ");
+    print_int(zs.fault_ns_avg);
+    print_string(" ns, data intact: ");
+    print_string(intact ? "yes" : "NO");
+    print_string("\n");
+    
+    vm_release(region);
+}
+
 void test_timer_control(void) {
     print_string("\n=== TIMER CONTROL AND TESTING ===\n");
     print_string("Current timer status: ");
@@ -379,8 +481,13 @@ void test_timer_control(void) {
     test_timer_control();
 }
 
+// Scratch memory for the running command; freed when it returns
+void* shell_alloc(size_t size) {
+    return arena_alloc(&command_arena, size);
+}
+
 // Main command handler
-void execute_command(char* cmd) {
+static void run_command(char* cmd) {
     char* args[MAX_ARGS];
     int arg_count = parse_args(cmd, args);
     
@@ -438,14 +545,33 @@ void execute_command(char* cmd) {
         }
     }
     else if (strcmp(args[0], "echo") == 0) {
-        // echo: accepts multiple arguments
+        // echo: accepts multiple arguments, joined into one line
+        size_t len = 2; // Newline and terminator
+        for (int i = 1; i < arg_count; i++) {
+            for (const char* p = args[i]; *p; p++) {
+                len++;
+            }
+            len++; // Separator
+        }
+        
+        char* line = (char*)shell_alloc(len);
+        if (!line) {
+            print_string("echo: out of memory\n");
+            return;
+        }
+        
+        char* out = line;
         for (int i = 1; i < arg_count; i++) {
-            print_string(args[i]);
+            for (const char* p = args[i]; *p; p++) {
+                *out++ = *p;
+            }
             if (i < arg_count - 1) {
-                print_char(' ');
+                *out++ = ' ';
             }
         }
-        print_string("\n");
+        *out++ = '\n';
+        *out = '\0';
+        print_string(line);
     }
     else if (strcmp(args[0], "shutdown") == 0) {
         // shutdown: no arguments expected
@@ -474,28 +600,35 @@ void execute_command(char* cmd) {
         }
     }
     else if (strcmp(args[0], "meminfo") == 0) {
-        // Check for unit arguments - only allow KB
+        // Options: --kb for KB units, --verbose for heap/fragmentation detail
         int unit = UNIT_MB; // Default to MB
+        boolean verbose = FALSE;
         boolean valid_args = TRUE;
         
-        if (arg_count > 2) {
-            print_string("Usage: meminfo [--kb]\n");
+        if (arg_count > 3) {
+            print_string("Usage: meminfo [--kb] [--verbose]\n");
             valid_args = FALSE;
         } 
-        else if (arg_count == 2) {
-            if (strcmp(args[1], "--kb") == 0) {
+        for (int i = 1; valid_args && i < arg_count; i++) {
+            if (strcmp(args[i], "--kb") == 0) {
                 unit = UNIT_KB;
             } 
+            else if (strcmp(args[i], "--verbose") == 0 || strcmp(args[i], "-v") == 0) {
+                verbose = TRUE;
+            }
             else {
                 print_string("Unknown option: ");
-                print_string(args[1]);
-                print_string("\nUsage: meminfo [--kb]\n");
+                print_string(args[i]);
+                print_string("\nUsage: meminfo [--kb] [--verbose]\n");
                 valid_args = FALSE;
             }
         }
         
         if (valid_args) {
             mm_dump_stats_with_unit(unit);
+            if (verbose) {
+                mm_dump_verbose();
+            }
         }
     }
     // Debug commands - only available when debug mode is enabled
@@ -525,6 +658,22 @@ void execute_command(char* cmd) {
             test_irq_handling();
         }
     }
+    else if (debug_mode && strcmp(args[0], "allocs") == 0) {
+        // allocs: reports from the allocation profiler (debug --memory on)
+        if (arg_count < 2 || strcmp(args[1], "top") == 0) {
+            allocprof_dump_top(arg_count > 2 ? str_to_int(args[2]) : 0);
+        }
+        else if (strcmp(args[1], "snapshot") == 0) {
+            allocprof_snapshot();
+            print_string("Snapshot taken; 'allocs leaks' compares the last two\n");
+        }
+        else if (strcmp(args[1], "leaks") == 0) {
+            allocprof_dump_leaks();
+        }
+        else {
+            print_string("Usage: allocs [top [n] | snapshot | leaks]\n");
+        }
+    }
     else if (debug_mode && strcmp(args[0], "timer") == 0) {
         // timer: no arguments expected
         if (arg_count > 1) {
@@ -557,7 +706,30 @@ void execute_command(char* cmd) {
             debug_cursor_blink();
         }
         else if (debug_mode && strcmp(args[1], "--memory") == 0) {
-            mm_dump_stats();
+            // --memory on/off toggles the allocation profiler
+            if (arg_count > 2 && strcmp(args[2], "on") == 0) {
+                allocprof_enable(TRUE);
+                print_string("Allocation profiling on; see 'allocs'\n");
+            } else if (arg_count > 2 && strcmp(args[2], "off") == 0) {
+                allocprof_enable(FALSE);
+                print_string("Allocation profiling off\n");
+            } else {
+                mm_dump_stats();
+                print_string("Allocation profiling: ");
+                print_string(allocprof_active ? "on\n" : "off (debug --memory on)\n");
+            }
+        }
+        else if (debug_mode && strcmp(args[1], "--membench") == 0) {
+            mm_benchmark();
+        }
+        else if (debug_mode && strcmp(args[1], "--lazy") == 0) {
+            test_lazy_pages();
+        }
+        else if (debug_mode && strcmp(args[1], "--zram") == 0) {
+            test_zram_pages();
+        }
+        else if (debug_mode && strcmp(args[1], "--console") == 0) {
+            debug_console_ring();
         }
         else if (debug_mode && strcmp(args[1], "--timer") == 0) {
             test_timer_control();
@@ -570,7 +742,11 @@ void execute_command(char* cmd) {
             if (debug_mode) {
                 print_string("Debug options:\n");
                 print_string("  --cursor-blink   Debug cursor blinking functionality\n");
-                print_string("  --memory         Display memory information\n");
+                print_string("  --memory [on|off] Display memory information, toggle profiling\n");
+                print_string("  --membench       Benchmark the frame allocator\n");
+                print_string("  --lazy           Test demand-zero page faults\n");
+                print_string("  --zram           Test compressed page eviction\n");
+                print_string("  --console        Test console scrollback wrap-around\n");
                 print_string("  --timer          Test timer functionality\n");
             }
         }
@@ -582,7 +758,14 @@ void execute_command(char* cmd) {
     }
 }
 
-// Add this shell_main function if it doesn't exist
+// Run one command line, then drop its scratch memory
+void execute_command(char* cmd) {
+    run_command(cmd);
+    
+    // Everything the command took from shell_alloc() goes at once
+    arena_reset(&command_arena);
+}
+
 void shell_main(void) {
     // Main command loop
     while(1) {
@@ -1,11 +1,17 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include "../data/types.h"
+
 // Main shell entry point
 void shell_main(void);
 
 // Execute a command
 void execute_command(char* cmd);
 
+// Scratch memory for the command being executed. Never freed individually;
+// all of it is released when execute_command() returns.
+void* shell_alloc(size_t size);
+
 #endif // SHELL_H
 